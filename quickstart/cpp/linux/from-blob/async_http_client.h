@@ -0,0 +1,1030 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// async_http_client.h
+//
+// Single-threaded, event-driven HTTP/1.1 client on epoll: keep-alive connections (plain or TLS through OpenSSL),
+// pipelined requests and gzip response decoding (zlib). All requests and timers are driven by Run() on one thread;
+// callbacks run on that thread and may issue further requests. An exception thrown by a callback is caught, so that it
+// ends only its own request, and passed to the callback error handler.
+//
+
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <zlib.h>
+
+struct HttpRequest
+{
+    std::string Method = "GET";
+    std::string Url;
+    std::vector<std::pair<std::string, std::string>> Headers;
+    std::string Body;
+};
+
+struct HttpResponse
+{
+    // 0 if the request failed before a response was received; Error then says why.
+    int StatusCode = 0;
+    std::string Error;
+    // Header names are lowercase.
+    std::map<std::string, std::string> Headers;
+    // Decoded (gunzipped) body.
+    std::string Body;
+
+    std::string Header(const std::string& name) const
+    {
+        auto header = Headers.find(name);
+        return header == Headers.end() ? std::string() : header->second;
+    }
+};
+
+class AsyncHttpClient final
+{
+public:
+    typedef std::function<void(HttpResponse&&)> ResponseCallback;
+
+    // Up to 'maxConnectionsPerHost' connections are opened per scheme, host and port, and up to 'maxPipelineDepth'
+    // requests are in flight on each of them; further requests wait in a queue.
+    explicit AsyncHttpClient(size_t maxConnectionsPerHost = 4, size_t maxPipelineDepth = 8)
+        : m_maxConnectionsPerHost(maxConnectionsPerHost), m_maxPipelineDepth(maxPipelineDepth)
+    {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll < 0)
+        {
+            throw std::runtime_error("epoll_create1 failed: " + std::string(strerror(errno)));
+        }
+
+        m_tlsContext = SSL_CTX_new(TLS_client_method());
+        if (m_tlsContext == nullptr)
+        {
+            close(m_epoll);
+            throw std::runtime_error("SSL_CTX_new failed.");
+        }
+        SSL_CTX_set_default_verify_paths(m_tlsContext);
+        SSL_CTX_set_verify(m_tlsContext, SSL_VERIFY_PEER, nullptr);
+
+        // OpenSSL writes to the socket without MSG_NOSIGNAL; a server closing a connection must not kill the process.
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    ~AsyncHttpClient()
+    {
+        for (auto& origin : m_origins)
+        {
+            for (auto& connection : origin.second.Connections)
+            {
+                Close(*connection);
+            }
+        }
+        SSL_CTX_free(m_tlsContext);
+        close(m_epoll);
+    }
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    // Skips the verification of server certificates, e.g. for a local test server with a self-signed certificate.
+    void DisableCertificateVerification()
+    {
+        SSL_CTX_set_verify(m_tlsContext, SSL_VERIFY_NONE, nullptr);
+        m_verifyCertificates = false;
+    }
+
+    // Sets the function that receives the message of an exception thrown by a response or timer callback. By default,
+    // it is written to stderr.
+    void SetCallbackErrorHandler(std::function<void(const std::string&)> handler)
+    {
+        m_callbackErrorHandler = std::move(handler);
+    }
+
+    // Sends the request; 'callback' is called from Run() with the response, never from Send() itself (a request that
+    // cannot be sent fails through a timer).
+    void Send(HttpRequest request, ResponseCallback callback)
+    {
+        Url url;
+        if (!ParseUrl(request.Url, &url))
+        {
+            HttpResponse response;
+            response.Error = "Invalid URL: " + request.Url;
+            After(std::chrono::milliseconds(0), [callback, response]() mutable { callback(std::move(response)); });
+            return;
+        }
+
+        PendingRequest pending;
+        pending.Request = std::move(request);
+        pending.Target = url.Target;
+        pending.Callback = std::move(callback);
+
+        auto& origin = m_origins[url.Origin];
+        if (origin.Host.empty())
+        {
+            origin.Host = url.Host;
+            origin.Port = url.Port;
+            origin.Tls = url.Tls;
+        }
+        origin.Queue.push_back(std::move(pending));
+        m_pending++;
+        Dispatch(origin);
+    }
+
+    // Calls 'callback' from Run() after 'delay'.
+    void After(std::chrono::milliseconds delay, std::function<void()> callback)
+    {
+        m_timers.emplace(std::chrono::steady_clock::now() + delay, std::move(callback));
+    }
+
+    // Runs the event loop until no requests and timers are left.
+    void Run()
+    {
+        epoll_event events[64];
+        while (m_pending > 0 || !m_timers.empty())
+        {
+            int timeout = -1;
+            if (!m_timers.empty())
+            {
+                auto untilNext = std::chrono::duration_cast<std::chrono::milliseconds>(m_timers.begin()->first - std::chrono::steady_clock::now()).count();
+                timeout = (int)std::max<long long>(0, untilNext);
+            }
+
+            auto count = epoll_wait(m_epoll, events, 64, timeout);
+            if (count < 0 && errno != EINTR)
+            {
+                throw std::runtime_error("epoll_wait failed: " + std::string(strerror(errno)));
+            }
+            for (int i = 0; i < count; i++)
+            {
+                auto connection = (Connection*)events[i].data.ptr;
+                if (connection->Fd >= 0)
+                {
+                    HandleEvent(*connection, events[i].events);
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            while (!m_timers.empty() && m_timers.begin()->first <= now)
+            {
+                auto callback = std::move(m_timers.begin()->second);
+                m_timers.erase(m_timers.begin());
+                Invoke(callback);
+            }
+
+            RemoveClosedConnections();
+        }
+    }
+
+private:
+    struct Url
+    {
+        bool Tls = false;
+        std::string Host;
+        std::string Port;
+        std::string Origin;
+        std::string Target;
+    };
+
+    struct PendingRequest
+    {
+        HttpRequest Request;
+        std::string Target;
+        ResponseCallback Callback;
+        bool Retried = false;
+    };
+
+    enum class ConnectionState { Connecting, Handshaking, Open, Closed };
+
+    // Incremental parser of the responses on one connection.
+    struct ResponseParser
+    {
+        enum class Stage { Head, Body, ChunkSize, ChunkData, Trailers, BodyUntilClose };
+        Stage Current = Stage::Head;
+        HttpResponse Response;
+        size_t Remaining = 0;
+    };
+
+    struct Origin;
+
+    struct Connection
+    {
+        Origin* Owner = nullptr;
+        int Fd = -1;
+        SSL* Tls = nullptr;
+        ConnectionState State = ConnectionState::Connecting;
+        uint32_t Events = 0;
+        std::string WriteBuffer;
+        size_t WriteOffset = 0;
+        std::string ReadBuffer;
+        size_t ReadOffset = 0;
+        std::deque<PendingRequest> InFlight;
+        const addrinfo* Address = nullptr;      // The address of the host being connected to.
+        ResponseParser Parser;
+        size_t Responses = 0;
+    };
+
+    struct Origin
+    {
+        std::string Host;
+        std::string Port;
+        bool Tls = false;
+        // Set once the server closed a connection after its first response; requests to it are no longer pipelined.
+        bool NoKeepAlive = false;
+        std::shared_ptr<addrinfo> Address;
+        std::deque<PendingRequest> Queue;
+        std::vector<std::unique_ptr<Connection>> Connections;
+    };
+
+    static bool ParseUrl(const std::string& text, Url* url)
+    {
+        auto schemeEnd = text.find("://");
+        if (schemeEnd == std::string::npos)
+        {
+            return false;
+        }
+        auto scheme = text.substr(0, schemeEnd);
+        if (strcasecmp(scheme.c_str(), "https") == 0)
+        {
+            url->Tls = true;
+        }
+        else if (strcasecmp(scheme.c_str(), "http") != 0)
+        {
+            return false;
+        }
+
+        auto authorityStart = schemeEnd + 3;
+        auto targetStart = text.find_first_of("/?", authorityStart);
+        auto authority = text.substr(authorityStart, targetStart == std::string::npos ? std::string::npos : targetStart - authorityStart);
+        url->Target = targetStart == std::string::npos ? "/" : text.substr(targetStart);
+        if (url->Target[0] == '?')
+        {
+            url->Target.insert(0, "/");
+        }
+
+        auto colon = authority.rfind(':');
+        if (colon != std::string::npos && authority.find(']', colon) == std::string::npos)
+        {
+            url->Host = authority.substr(0, colon);
+            url->Port = authority.substr(colon + 1);
+        }
+        else
+        {
+            url->Host = authority;
+            url->Port = url->Tls ? "443" : "80";
+        }
+        if (url->Host.size() > 1 && url->Host.front() == '[')
+        {
+            url->Host = url->Host.substr(1, url->Host.size() - 2);
+        }
+        url->Origin = (url->Tls ? "https://" : "http://") + url->Host + ":" + url->Port;
+        return !url->Host.empty();
+    }
+
+    static bool IsIdempotent(const std::string& method)
+    {
+        return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+    }
+
+    // Moves queued requests of the origin onto connections with pipeline capacity, opening connections as needed.
+    void Dispatch(Origin& origin)
+    {
+        while (!origin.Queue.empty())
+        {
+            Connection* best = nullptr;
+            for (auto& connection : origin.Connections)
+            {
+                if (connection->State != ConnectionState::Closed && connection->InFlight.size() < (origin.NoKeepAlive ? 1 : m_maxPipelineDepth) &&
+                    (best == nullptr || connection->InFlight.size() < best->InFlight.size()))
+                {
+                    best = connection.get();
+                }
+            }
+
+            // Prefer a new connection over deepening a pipeline.
+            if ((best == nullptr || !best->InFlight.empty()) && OpenConnections(origin) < m_maxConnectionsPerHost)
+            {
+                auto connection = Connect(origin);
+                if (connection == nullptr)
+                {
+                    // Connect() failed all queued requests.
+                    return;
+                }
+                best = connection;
+            }
+            if (best == nullptr)
+            {
+                return;
+            }
+
+            auto pending = std::move(origin.Queue.front());
+            origin.Queue.pop_front();
+            Serialize(origin, pending, best->WriteBuffer);
+            best->InFlight.push_back(std::move(pending));
+            if (best->State == ConnectionState::Open)
+            {
+                Flush(*best);
+            }
+        }
+    }
+
+    static size_t OpenConnections(const Origin& origin)
+    {
+        size_t count = 0;
+        for (const auto& connection : origin.Connections)
+        {
+            count += connection->State != ConnectionState::Closed ? 1 : 0;
+        }
+        return count;
+    }
+
+    static void Serialize(const Origin& origin, const PendingRequest& pending, std::string& buffer)
+    {
+        const auto& request = pending.Request;
+        buffer += request.Method + " " + pending.Target + " HTTP/1.1\r\nHost: " + origin.Host;
+        if (origin.Port != (origin.Tls ? "443" : "80"))
+        {
+            buffer += ":" + origin.Port;
+        }
+        buffer += "\r\nAccept-Encoding: gzip\r\n";
+        for (const auto& header : request.Headers)
+        {
+            buffer += header.first + ": " + header.second + "\r\n";
+        }
+        if (!request.Body.empty() || request.Method == "POST" || request.Method == "PUT")
+        {
+            buffer += "Content-Length: " + std::to_string(request.Body.size()) + "\r\n";
+        }
+        buffer += "\r\n";
+        buffer += request.Body;
+    }
+
+    Connection* Connect(Origin& origin)
+    {
+        std::string error;
+        if (!origin.Address)
+        {
+            // Resolved once per origin; getaddrinfo blocks, but only on the first request to a host.
+            addrinfo hints = {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* address = nullptr;
+            auto result = getaddrinfo(origin.Host.c_str(), origin.Port.c_str(), &hints, &address);
+            if (result != 0)
+            {
+                error = "Failed to resolve " + origin.Host + ": " + gai_strerror(result);
+            }
+            else
+            {
+                origin.Address.reset(address, freeaddrinfo);
+            }
+        }
+
+        int fd = -1;
+        const addrinfo* address = origin.Address.get();
+        if (address != nullptr)
+        {
+            fd = ConnectSocket(origin, &address, &error);
+        }
+
+        if (fd < 0)
+        {
+            FailAll(origin.Queue, error);
+            return nullptr;
+        }
+
+        origin.Connections.emplace_back(new Connection());
+        auto connection = origin.Connections.back().get();
+        connection->Owner = &origin;
+        connection->Fd = fd;
+        connection->Address = address;
+        connection->State = ConnectionState::Connecting;
+        UpdateEvents(*connection, EPOLLIN | EPOLLOUT, true);
+        return connection;
+    }
+
+    // Starts connecting a non-blocking socket to '*address' or, if that fails right away, to the addresses after it.
+    // Returns the socket and sets '*address' to the one being connected to, or returns -1 and sets 'error'.
+    static int ConnectSocket(const Origin& origin, const addrinfo** address, std::string* error)
+    {
+        for (; *address != nullptr; *address = (*address)->ai_next)
+        {
+            auto fd = socket((*address)->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && (connect(fd, (*address)->ai_addr, (*address)->ai_addrlen) == 0 || errno == EINPROGRESS))
+            {
+                // Requests are small and latency-bound; do not hold them back waiting for acknowledgments.
+                int noDelay = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                return fd;
+            }
+            *error = "Failed to connect to " + origin.Host + ": " + strerror(errno);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        return -1;
+    }
+
+    void UpdateEvents(Connection& connection, uint32_t events, bool add = false)
+    {
+        if (!add && connection.Events == events)
+        {
+            return;
+        }
+        epoll_event event = {};
+        event.events = events;
+        event.data.ptr = &connection;
+        epoll_ctl(m_epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection.Fd, &event);
+        connection.Events = events;
+    }
+
+    void HandleEvent(Connection& connection, uint32_t events)
+    {
+        if (connection.State == ConnectionState::Connecting)
+        {
+            int socketError = 0;
+            socklen_t length = sizeof(socketError);
+            getsockopt(connection.Fd, SOL_SOCKET, SO_ERROR, &socketError, &length);
+            if (socketError != 0)
+            {
+                // Falls back to the next address of the host, e.g. from an unreachable IPv6 address to IPv4.
+                std::string error = "Failed to connect to " + connection.Owner->Host + ": " + strerror(socketError);
+                const addrinfo* next = connection.Address->ai_next;
+                auto fd = next != nullptr ? ConnectSocket(*connection.Owner, &next, &error) : -1;
+                if (fd < 0)
+                {
+                    Fail(connection, error);
+                    return;
+                }
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, connection.Fd, nullptr);
+                close(connection.Fd);
+                connection.Fd = fd;
+                connection.Address = next;
+                UpdateEvents(connection, EPOLLIN | EPOLLOUT, true);
+                return;
+            }
+            if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0)
+            {
+                return;
+            }
+            if (connection.Owner->Tls)
+            {
+                connection.Tls = SSL_new(m_tlsContext);
+                SSL_set_fd(connection.Tls, connection.Fd);
+                SSL_set_tlsext_host_name(connection.Tls, connection.Owner->Host.c_str());
+                if (m_verifyCertificates)
+                {
+                    SSL_set1_host(connection.Tls, connection.Owner->Host.c_str());
+                }
+                connection.State = ConnectionState::Handshaking;
+            }
+            else
+            {
+                connection.State = ConnectionState::Open;
+            }
+        }
+
+        if (connection.State == ConnectionState::Handshaking)
+        {
+            auto result = SSL_connect(connection.Tls);
+            if (result != 1)
+            {
+                auto error = SSL_get_error(connection.Tls, result);
+                if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+                {
+                    UpdateEvents(connection, error == SSL_ERROR_WANT_WRITE ? EPOLLIN | EPOLLOUT : EPOLLIN);
+                    return;
+                }
+                Fail(connection, "TLS handshake with " + connection.Owner->Host + " failed: " + TlsError());
+                return;
+            }
+            connection.State = ConnectionState::Open;
+        }
+
+        if (!Flush(connection))
+        {
+            return;
+        }
+        Receive(connection);
+    }
+
+    // Writes as much of the write buffer as the socket takes. Returns false if the connection failed.
+    bool Flush(Connection& connection)
+    {
+        while (connection.WriteOffset < connection.WriteBuffer.size())
+        {
+            auto data = connection.WriteBuffer.data() + connection.WriteOffset;
+            auto size = connection.WriteBuffer.size() - connection.WriteOffset;
+            ssize_t written;
+            if (connection.Tls != nullptr)
+            {
+                written = SSL_write(connection.Tls, data, (int)size);
+                if (written <= 0)
+                {
+                    auto error = SSL_get_error(connection.Tls, (int)written);
+                    if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ)
+                    {
+                        break;
+                    }
+                    FailAfterReceive(connection, "Sending to " + connection.Owner->Host + " failed: " + TlsError());
+                    return false;
+                }
+            }
+            else
+            {
+                written = send(connection.Fd, data, size, MSG_NOSIGNAL);
+                if (written < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        break;
+                    }
+                    FailAfterReceive(connection, "Sending to " + connection.Owner->Host + " failed: " + strerror(errno));
+                    return false;
+                }
+            }
+            connection.WriteOffset += (size_t)written;
+        }
+
+        if (connection.WriteOffset == connection.WriteBuffer.size())
+        {
+            connection.WriteBuffer.clear();
+            connection.WriteOffset = 0;
+            UpdateEvents(connection, EPOLLIN);
+        }
+        else
+        {
+            UpdateEvents(connection, EPOLLIN | EPOLLOUT);
+        }
+        return true;
+    }
+
+    void Receive(Connection& connection)
+    {
+        char buffer[16384];
+        bool closed = false;
+        for (;;)
+        {
+            ssize_t received;
+            if (connection.Tls != nullptr)
+            {
+                received = SSL_read(connection.Tls, buffer, sizeof(buffer));
+                if (received <= 0)
+                {
+                    auto error = SSL_get_error(connection.Tls, (int)received);
+                    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+                    {
+                        break;
+                    }
+                    closed = true;
+                    break;
+                }
+            }
+            else
+            {
+                received = recv(connection.Fd, buffer, sizeof(buffer), 0);
+                if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                if (received <= 0)
+                {
+                    closed = true;
+                    break;
+                }
+            }
+            connection.ReadBuffer.append(buffer, (size_t)received);
+        }
+
+        Parse(connection, closed);
+        if (closed && connection.State != ConnectionState::Closed)
+        {
+            Fail(connection, "Connection to " + connection.Owner->Host + " closed by the server.");
+        }
+    }
+
+    // Handles a failed send: the server may have closed the connection after responding (e.g. "Connection: close"),
+    // so the responses it sent are processed before the remaining requests are failed or retried.
+    void FailAfterReceive(Connection& connection, const std::string& error)
+    {
+        Receive(connection);
+        if (connection.State != ConnectionState::Closed)
+        {
+            Fail(connection, error);
+        }
+    }
+
+    // Parses all complete responses in the read buffer and completes the matching in-flight requests, in order.
+    void Parse(Connection& connection, bool closed)
+    {
+        auto& parser = connection.Parser;
+        auto& buffer = connection.ReadBuffer;
+        for (;;)
+        {
+            if (parser.Current == ResponseParser::Stage::Head)
+            {
+                auto end = buffer.find("\r\n\r\n", connection.ReadOffset);
+                if (end == std::string::npos)
+                {
+                    break;
+                }
+                if (!ParseHead(buffer.substr(connection.ReadOffset, end - connection.ReadOffset), &parser.Response))
+                {
+                    Fail(connection, "Invalid response from " + connection.Owner->Host);
+                    return;
+                }
+                connection.ReadOffset = end + 4;
+
+                // Interim (1xx) responses precede the final response of the same request.
+                if (parser.Response.StatusCode < 200)
+                {
+                    parser.Response = HttpResponse();
+                    continue;
+                }
+
+                auto isHead = !connection.InFlight.empty() && connection.InFlight.front().Request.Method == "HEAD";
+                auto contentLength = parser.Response.Header("content-length");
+                if (isHead || parser.Response.StatusCode == 204 || parser.Response.StatusCode == 304)
+                {
+                    parser.Remaining = 0;
+                    parser.Current = ResponseParser::Stage::Body;
+                }
+                else if (strcasecmp(parser.Response.Header("transfer-encoding").c_str(), "chunked") == 0)
+                {
+                    parser.Current = ResponseParser::Stage::ChunkSize;
+                }
+                else if (!contentLength.empty())
+                {
+                    if (!ParseContentLength(contentLength, &parser.Remaining))
+                    {
+                        Fail(connection, "Invalid Content-Length from " + connection.Owner->Host);
+                        return;
+                    }
+                    parser.Current = ResponseParser::Stage::Body;
+                }
+                else
+                {
+                    parser.Current = ResponseParser::Stage::BodyUntilClose;
+                }
+            }
+
+            if (parser.Current == ResponseParser::Stage::Body || parser.Current == ResponseParser::Stage::ChunkData)
+            {
+                auto available = std::min(parser.Remaining, buffer.size() - connection.ReadOffset);
+                parser.Response.Body.append(buffer, connection.ReadOffset, available);
+                connection.ReadOffset += available;
+                parser.Remaining -= available;
+                if (parser.Remaining > 0)
+                {
+                    break;
+                }
+                if (parser.Current == ResponseParser::Stage::ChunkData)
+                {
+                    if (buffer.size() - connection.ReadOffset < 2)
+                    {
+                        break;
+                    }
+                    connection.ReadOffset += 2;
+                    parser.Current = ResponseParser::Stage::ChunkSize;
+                    continue;
+                }
+            }
+            else if (parser.Current == ResponseParser::Stage::ChunkSize)
+            {
+                auto end = buffer.find("\r\n", connection.ReadOffset);
+                if (end == std::string::npos)
+                {
+                    break;
+                }
+                errno = 0;
+                parser.Remaining = (size_t)strtoull(buffer.c_str() + connection.ReadOffset, nullptr, 16);
+                if (!isxdigit((unsigned char)buffer[connection.ReadOffset]) || errno == ERANGE)
+                {
+                    Fail(connection, "Invalid chunk size from " + connection.Owner->Host);
+                    return;
+                }
+                connection.ReadOffset = end + 2;
+                parser.Current = parser.Remaining == 0 ? ResponseParser::Stage::Trailers : ResponseParser::Stage::ChunkData;
+                continue;
+            }
+            else if (parser.Current == ResponseParser::Stage::Trailers)
+            {
+                auto end = buffer.find("\r\n", connection.ReadOffset);
+                if (end == std::string::npos)
+                {
+                    break;
+                }
+                auto empty = end == connection.ReadOffset;
+                connection.ReadOffset = end + 2;
+                if (!empty)
+                {
+                    continue;
+                }
+            }
+            else if (parser.Current == ResponseParser::Stage::BodyUntilClose)
+            {
+                parser.Response.Body.append(buffer, connection.ReadOffset, std::string::npos);
+                connection.ReadOffset = buffer.size();
+                if (!closed)
+                {
+                    break;
+                }
+            }
+
+            // The response is complete.
+            auto response = std::move(parser.Response);
+            parser = ResponseParser();
+            auto keepAlive = strcasecmp(response.Header("connection").c_str(), "close") != 0 && !closed;
+            if (!Complete(connection, std::move(response)) || connection.State == ConnectionState::Closed)
+            {
+                return;
+            }
+            if (!keepAlive)
+            {
+                // Requests pipelined behind this response were not processed; send them again on a new connection.
+                connection.Owner->NoKeepAlive = connection.Owner->NoKeepAlive || connection.Responses == 1;
+                Fail(connection, "Connection to " + connection.Owner->Host + " closed by the server.", true);
+                return;
+            }
+        }
+
+        // Drops consumed data once it makes up most of the buffer.
+        if (connection.ReadOffset > 0 && connection.ReadOffset * 2 >= buffer.size())
+        {
+            buffer.erase(0, connection.ReadOffset);
+            connection.ReadOffset = 0;
+        }
+    }
+
+    // Parses a Content-Length value: decimal digits, optionally followed by whitespace, that fit in a size_t.
+    static bool ParseContentLength(const std::string& value, size_t* length)
+    {
+        size_t i = 0;
+        size_t result = 0;
+        for (; i < value.size() && value[i] >= '0' && value[i] <= '9'; i++)
+        {
+            if (result > (SIZE_MAX - 9) / 10)
+            {
+                return false;
+            }
+            result = result * 10 + (size_t)(value[i] - '0');
+        }
+        if (i == 0 || value.find_first_not_of(" \t", i) != std::string::npos)
+        {
+            return false;
+        }
+        *length = result;
+        return true;
+    }
+
+    static bool ParseHead(const std::string& head, HttpResponse* response)
+    {
+        auto lineEnd = head.find("\r\n");
+        auto statusLine = head.substr(0, lineEnd);
+        if (statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.size() < 12)
+        {
+            return false;
+        }
+        response->StatusCode = atoi(statusLine.c_str() + 9);
+
+        while (lineEnd != std::string::npos)
+        {
+            auto start = lineEnd + 2;
+            lineEnd = head.find("\r\n", start);
+            auto line = head.substr(start, lineEnd == std::string::npos ? std::string::npos : lineEnd - start);
+            auto colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            auto name = line.substr(0, colon);
+            for (auto& c : name)
+            {
+                c = (char)tolower((unsigned char)c);
+            }
+            auto valueStart = line.find_first_not_of(" \t", colon + 1);
+            response->Headers[name] = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+        }
+        return true;
+    }
+
+    // Completes the oldest in-flight request of the connection. Returns false if there was none.
+    bool Complete(Connection& connection, HttpResponse&& response)
+    {
+        if (connection.InFlight.empty())
+        {
+            Fail(connection, "Unexpected response from " + connection.Owner->Host);
+            return false;
+        }
+
+        if (strcasecmp(response.Header("content-encoding").c_str(), "gzip") == 0)
+        {
+            std::string decoded;
+            if (Gunzip(response.Body, &decoded))
+            {
+                response.Body.swap(decoded);
+                response.Headers.erase("content-encoding");
+            }
+            else
+            {
+                response.StatusCode = 0;
+                response.Error = "Failed to decode the gzip response body.";
+            }
+        }
+
+        auto pending = std::move(connection.InFlight.front());
+        connection.InFlight.pop_front();
+        connection.Responses++;
+        m_pending--;
+
+        auto origin = connection.Owner;
+        Invoke([&]() { pending.Callback(std::move(response)); });
+        Dispatch(*origin);
+        return true;
+    }
+
+    static bool Gunzip(const std::string& compressed, std::string* decoded)
+    {
+        z_stream stream = {};
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        {
+            return false;
+        }
+        stream.next_in = (Bytef*)compressed.data();
+        stream.avail_in = (uInt)compressed.size();
+
+        char buffer[65536];
+        int result;
+        do
+        {
+            stream.next_out = (Bytef*)buffer;
+            stream.avail_out = sizeof(buffer);
+            result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END)
+            {
+                break;
+            }
+            decoded->append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (result != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+
+        inflateEnd(&stream);
+        return result == Z_STREAM_END;
+    }
+
+    // Closes the connection. If the server is known not to have processed the requests in flight ('unprocessed'), they are
+    // all sent again. Otherwise idempotent requests are sent again and the others fail with 'error'; only the oldest
+    // request, the one the failure may be due to, is charged its single retry, as the requests pipelined behind it are
+    // typically lost with the connection.
+    void Fail(Connection& connection, const std::string& error, bool unprocessed = false)
+    {
+        auto origin = connection.Owner;
+        auto inFlight = std::move(connection.InFlight);
+        connection.InFlight.clear();
+        Close(connection);
+
+        std::deque<PendingRequest> failed;
+        for (size_t i = inFlight.size(); i-- > 0;)
+        {
+            auto& pending = inFlight[i];
+            auto oldest = i == 0;
+            if (unprocessed || (IsIdempotent(pending.Request.Method) && !(oldest && pending.Retried)))
+            {
+                pending.Retried = pending.Retried || (oldest && !unprocessed);
+                origin->Queue.push_front(std::move(pending));
+            }
+            else
+            {
+                failed.push_front(std::move(pending));
+            }
+        }
+        FailAll(failed, error);
+        Dispatch(*origin);
+    }
+
+    void FailAll(std::deque<PendingRequest>& requests, const std::string& error)
+    {
+        auto failed = std::move(requests);
+        requests.clear();
+        for (auto& pending : failed)
+        {
+            m_pending--;
+            HttpResponse response;
+            response.Error = error;
+            Invoke([&]() { pending.Callback(std::move(response)); });
+        }
+    }
+
+    // Calls a callback, catching what it throws so that the other requests are not affected.
+    template <class Callback>
+    void Invoke(Callback&& callback)
+    {
+        try
+        {
+            callback();
+        }
+        catch (const std::exception& e)
+        {
+            ReportCallbackError(e.what());
+        }
+        catch (...)
+        {
+            ReportCallbackError("Unknown exception.");
+        }
+    }
+
+    void ReportCallbackError(const std::string& message)
+    {
+        if (m_callbackErrorHandler)
+        {
+            m_callbackErrorHandler("Callback failed: " + message);
+        }
+        else
+        {
+            fprintf(stderr, "Callback failed: %s\n", message.c_str());
+        }
+    }
+
+    void Close(Connection& connection)
+    {
+        if (connection.Tls != nullptr)
+        {
+            SSL_free(connection.Tls);
+            connection.Tls = nullptr;
+        }
+        if (connection.Fd >= 0)
+        {
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, connection.Fd, nullptr);
+            close(connection.Fd);
+            connection.Fd = -1;
+        }
+        connection.State = ConnectionState::Closed;
+    }
+
+    // Frees closed connections; only done between event batches, as an event may still refer to one.
+    void RemoveClosedConnections()
+    {
+        for (auto& origin : m_origins)
+        {
+            auto& connections = origin.second.Connections;
+            for (size_t i = 0; i < connections.size();)
+            {
+                if (connections[i]->State == ConnectionState::Closed)
+                {
+                    connections.erase(connections.begin() + i);
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+    }
+
+    static std::string TlsError()
+    {
+        char buffer[256];
+        auto error = ERR_get_error();
+        if (error == 0)
+        {
+            return strerror(errno);
+        }
+        ERR_error_string_n(error, buffer, sizeof(buffer));
+        return buffer;
+    }
+
+    size_t m_maxConnectionsPerHost;
+    size_t m_maxPipelineDepth;
+    int m_epoll = -1;
+    SSL_CTX* m_tlsContext = nullptr;
+    bool m_verifyCertificates = true;
+    size_t m_pending = 0;
+    std::map<std::string, Origin> m_origins;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_timers;
+    std::function<void(const std::string&)> m_callbackErrorHandler;
+};
@@ -0,0 +1,315 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <strings.h>
+
+#include <nlohmann/json.hpp>
+#include "async_http_client.h"
+#include "batch_results.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+const string region = "YourServiceRegion";
+const string subscriptionKey = "YourSubscriptionKey";
+const string name = "Simple transcription";
+const string description = "Simple transcription description";
+const string myLocale = "en-US";
+
+// One transcription is created per recording; all of them are created, polled and fetched concurrently.
+const vector<string> recordingsBlobUris = { "YourFileUrl" };
+
+class TranscriptionDefinition {
+public:
+    string Name;
+    string Description;
+    string RecordingsUrl;
+    string Locale;
+    std::list<string> Models;
+    std::map<string, string> properties;
+};
+
+void to_json(nlohmann::json& j, const TranscriptionDefinition& t) {
+    j = nlohmann::json{
+            { "description", t.Description },
+            { "locale", t.Locale },
+            { "models", t.Models },
+            { "name", t.Name },
+            { "properties", t.properties },
+            { "recordingsurl",t.RecordingsUrl }
+    };
+};
+
+class Transcription {
+public:
+    string name;
+    string description;
+    string locale;
+    string recordingsUrl;
+    map<string, string> resultsUrls;
+    string id;
+    string createdDateTime;
+    string lastActionDateTime;
+    string status;
+    string statusMessage;
+};
+
+void from_json(const nlohmann::json& j, Transcription& t) {
+    j.at("description").get_to(t.description);
+    j.at("locale").get_to(t.locale);
+    j.at("createdDateTime").get_to(t.createdDateTime);
+    j.at("name").get_to(t.name);
+    j.at("recordingsUrl").get_to(t.recordingsUrl);
+    t.resultsUrls = j.at("resultsUrls").get<map<string, string>>();
+    j.at("status").get_to(t.status);
+    t.statusMessage = j.value("statusMessage", "");
+}
+
+// One segment of the merged transcript, attributed to the speaker on its channel.
+struct TranscriptSegment
+{
+    int Channel;
+    const BatchResults* Results;
+    const FlatSegment* Segment;
+};
+
+// Merges the segments of all channels into one transcript ordered by offset, with a k-way merge over the channels.
+vector<TranscriptSegment> mergeChannels(const map<int, unique_ptr<BatchResults>>& results)
+{
+    // The segments of each channel, ordered by offset.
+    vector<vector<TranscriptSegment>> channels;
+    for (const auto& result : results)
+    {
+        channels.emplace_back();
+        for (const auto& audioFile : result.second->AudioFiles())
+        {
+            for (const auto& segment : result.second->Segments(audioFile))
+            {
+                channels.back().push_back({ result.first, result.second.get(), &segment });
+            }
+        }
+        stable_sort(channels.back().begin(), channels.back().end(), [](const TranscriptSegment& a, const TranscriptSegment& b)
+        {
+            return a.Segment->Offset < b.Segment->Offset;
+        });
+    }
+
+    // The heap holds the next segment of every channel as (offset, channel index, position); the smallest offset is on top.
+    typedef tuple<uint64_t, size_t, size_t> HeapEntry;
+    priority_queue<HeapEntry, vector<HeapEntry>, greater<HeapEntry>> heap;
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        if (!channels[i].empty())
+        {
+            heap.emplace(channels[i][0].Segment->Offset, i, 0);
+        }
+    }
+
+    vector<TranscriptSegment> transcript;
+    while (!heap.empty())
+    {
+        auto channelIndex = get<1>(heap.top());
+        auto position = get<2>(heap.top());
+        heap.pop();
+
+        transcript.push_back(channels[channelIndex][position]);
+        if (++position < channels[channelIndex].size())
+        {
+            heap.emplace(channels[channelIndex][position].Segment->Offset, channelIndex, position);
+        }
+    }
+    return transcript;
+}
+
+// One transcription job. Every step is a request on the shared client; its callback issues the next step, so any
+// number of jobs progress concurrently on the single thread running the client.
+class TranscriptionJob : public enable_shared_from_this<TranscriptionJob>
+{
+public:
+    TranscriptionJob(AsyncHttpClient& client, const string& recordingsUrl)
+        : m_client(client), m_recordingsUrl(recordingsUrl)
+    {
+    }
+
+    void start()
+    {
+        TranscriptionDefinition definition;
+        definition.Name = name;
+        definition.Description = description;
+        definition.Locale = myLocale;
+        definition.RecordingsUrl = m_recordingsUrl;
+
+        auto msg = makeRequest("POST", "https://" + region + ".cris.ai/api/speechtotext/v2.0/Transcriptions/");
+        msg.Headers.emplace_back("Content-Type", "application/json");
+        msg.Body = nlohmann::json(definition).dump();
+
+        auto self = shared_from_this();
+        m_client.Send(msg, [self](HttpResponse&& response)
+        {
+            if (response.StatusCode != 202)
+            {
+                self->report("Unexpected status code " + to_string(response.StatusCode) + " " + response.Error);
+                return;
+            }
+            self->m_statusUrl = response.Header("location");
+            self->report("Transcription status is located at " + self->m_statusUrl);
+            self->checkStatus();
+        });
+    }
+
+private:
+    HttpRequest makeRequest(const string& method, const string& url)
+    {
+        HttpRequest msg;
+        msg.Method = method;
+        msg.Url = url;
+        msg.Headers.emplace_back("Ocp-Apim-Subscription-Key", subscriptionKey);
+        return msg;
+    }
+
+    void report(const string& message)
+    {
+        cout << "[" << m_recordingsUrl << "] " << message << endl;
+    }
+
+    void checkStatus()
+    {
+        auto self = shared_from_this();
+        m_client.Send(makeRequest("GET", m_statusUrl), [self](HttpResponse&& response)
+        {
+            if (response.StatusCode != 200)
+            {
+                self->report("Fetching the transcription returned unexpected http code " + to_string(response.StatusCode) + " " + response.Error);
+                return;
+            }
+
+            Transcription transcriptionStatus = nlohmann::json::parse(response.Body);
+            if (!strcasecmp(transcriptionStatus.status.c_str(), "Failed"))
+            {
+                self->report("Transcription has failed " + transcriptionStatus.statusMessage);
+            }
+            else if (!strcasecmp(transcriptionStatus.status.c_str(), "Succeeded"))
+            {
+                self->report("Transcription has completed. Fetching the results of " + to_string(transcriptionStatus.resultsUrls.size()) + " channel(s)");
+                self->fetchResults(transcriptionStatus.resultsUrls);
+            }
+            else
+            {
+                self->report("Transcription is " + transcriptionStatus.status + ".");
+
+                // Polls at intervals that start short and grow, since short jobs finish quickly.
+                self->m_client.After(self->m_pollInterval, [self]() { self->checkStatus(); });
+                self->m_pollInterval = min(self->m_pollInterval * 2, chrono::milliseconds(30000));
+            }
+        });
+    }
+
+    // Downloads the results of all channels at once; each response is parsed as soon as it arrives.
+    void fetchResults(const map<string, string>& resultsUrls)
+    {
+        auto self = shared_from_this();
+        for (const auto& resultsUrl : resultsUrls)
+        {
+            if (resultsUrl.first.compare(0, 8, "channel_") != 0)
+            {
+                continue;
+            }
+            auto channel = stoi(resultsUrl.first.substr(8));
+            m_outstandingResults++;
+
+            m_client.Send(makeRequest("GET", resultsUrl.second), [self, channel](HttpResponse&& response)
+            {
+                if (response.StatusCode != 200)
+                {
+                    self->report("Fetching the results of channel " + to_string(channel) + " returned unexpected http code " + to_string(response.StatusCode) + " " + response.Error);
+                }
+                else
+                {
+                    // Parsed in one pass into the flat model; the response body is released right after. A channel that
+                    // cannot be parsed is reported and left out, so the other channels are still printed.
+                    try
+                    {
+                        self->m_results[channel] = BatchResults::Parse(response.Body);
+                    }
+                    catch (const exception& e)
+                    {
+                        self->report("Parsing the results of channel " + to_string(channel) + " failed: " + e.what());
+                    }
+                }
+
+                if (--self->m_outstandingResults == 0)
+                {
+                    self->printTranscript();
+                }
+            });
+        }
+    }
+
+    void printTranscript()
+    {
+        for (const auto& result : m_results)
+        {
+            for (const auto& af : result.second->AudioFiles())
+            {
+                report("There were " + to_string(af.SegmentCount) + " results in " + string(af.AudioFileName) + " on channel " + to_string(result.first));
+            }
+        }
+
+        // Each channel is one speaker (e.g. agent and customer of a stereo call recording).
+        for (const auto& merged : mergeChannels(m_results))
+        {
+            const auto& segResult = *merged.Segment;
+            auto nBest = merged.Results->NBest(segResult);
+            if (segResult.RecognitionStatus.size() == 7 && !strncasecmp(segResult.RecognitionStatus.data(), "success", 7) && !nBest.empty())
+            {
+                cout << "[" << segResult.Offset / 10000000.0 << " s] Speaker " << merged.Channel << ": '" << nBest.front().Display << "'" << endl;
+            }
+        }
+    }
+
+    AsyncHttpClient& m_client;
+    string m_recordingsUrl;
+    string m_statusUrl;
+    chrono::milliseconds m_pollInterval{ 1000 };
+    size_t m_outstandingResults = 0;
+    map<int, unique_ptr<BatchResults>> m_results;
+};
+
+void recognizeSpeech()
+{
+    AsyncHttpClient client;
+
+    for (const auto& recordingsBlobUri : recordingsBlobUris)
+    {
+        make_shared<TranscriptionJob>(client, recordingsBlobUri)->start();
+    }
+
+    // Runs all jobs to completion on this thread.
+    client.Run();
+}
+
+int main()
+{
+    try
+    {
+        recognizeSpeech();
+    }
+    catch (const exception& e)
+    {
+        cout << e.what() << endl;
+    }
+    return 0;
+}
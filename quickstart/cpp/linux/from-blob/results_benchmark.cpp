@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Google Benchmark micro-benchmarks of batch result parsing: a full nlohmann::json DOM versus the flat single-pass model
+// of batch_results.h. The input is a generated result file of the size given as the benchmark argument (in segments),
+// so results are comparable from release to release.
+//
+// Usage: results_benchmark [Google Benchmark flags, e.g. --benchmark_format=json]
+//
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include "batch_results.h"
+
+using namespace std;
+
+namespace
+{
+    // A result file with one audio file of 'segments' segments, each with 5 n-best entries of 12 words.
+    string GenerateResults(int segments)
+    {
+        nlohmann::json segmentResults = nlohmann::json::array();
+        for (int i = 0; i < segments; i++)
+        {
+            nlohmann::json nBest = nlohmann::json::array();
+            for (int n = 0; n < 5; n++)
+            {
+                string text = "segment " + to_string(i) + " alternative " + to_string(n) + " what's the weather like today in Seattle";
+                nBest.push_back({ { "Confidence", 0.9 - n * 0.1 }, { "Lexical", text }, { "ITN", text }, { "MaskedITN", text }, { "Display", text + "?" } });
+            }
+            segmentResults.push_back({ { "RecognitionStatus", "Success" }, { "ChannelNumber", "0" }, { "Offset", 10000000ULL * i },
+                { "Duration", 9000000 }, { "OffsetInSeconds", i * 1.0 }, { "DurationInSeconds", 0.9 }, { "NBest", nBest } });
+        }
+
+        nlohmann::json results = {
+            { "AudioFileResults", { {
+                { "AudioFileName", "recording.wav" },
+                { "AudioFileUrl", "https://example.blob.core.windows.net/recordings/recording.wav" },
+                { "AudioLengthInSeconds", segments * 1.0 },
+                { "CombinedResults", { { { "ChannelNumber", "0" }, { "Lexical", "combined" }, { "ITN", "combined" }, { "MaskedITN", "combined" }, { "Display", "Combined." } } } },
+                { "SegmentResults", segmentResults } } } }
+        };
+        return results.dump();
+    }
+
+    void BM_ParseDom(benchmark::State& state)
+    {
+        auto json = GenerateResults((int)state.range(0));
+        for (auto _ : state)
+        {
+            auto document = nlohmann::json::parse(json);
+            benchmark::DoNotOptimize(document.size());
+        }
+        state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)json.size());
+    }
+    BENCHMARK(BM_ParseDom)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+    void BM_ParseFlat(benchmark::State& state)
+    {
+        auto json = GenerateResults((int)state.range(0));
+        size_t modelBytes = 0;
+        for (auto _ : state)
+        {
+            auto results = BatchResults::Parse(json);
+            modelBytes = results->GetMemoryBytes();
+            benchmark::DoNotOptimize(results->AudioFiles().size());
+        }
+        state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)json.size());
+        state.counters["model_bytes"] = (double)modelBytes;
+        state.counters["input_bytes"] = (double)json.size();
+    }
+    BENCHMARK(BM_ParseFlat)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,308 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// batch_results.h
+//
+// Flat, read-only model of a batch transcription result file, built in a single SAX pass over the JSON without a DOM.
+// All strings live in one arena and are referenced by string_view; audio files, segments and n-best entries are each
+// stored in one contiguous vector, and a parent refers to its children by index range.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// A recognition result of a segment (an n-best entry, with its confidence) or of a whole channel (a combined result).
+struct FlatResult
+{
+    double Confidence = NAN;
+    std::string_view Lexical;
+    std::string_view ITN;
+    std::string_view MaskedITN;
+    std::string_view Display;
+};
+
+struct FlatSegment
+{
+    std::string_view RecognitionStatus;
+    uint64_t Offset = 0;
+    uint64_t Duration = 0;
+    size_t FirstNBest = 0;
+    size_t NBestCount = 0;
+};
+
+struct FlatAudioFile
+{
+    std::string_view AudioFileName;
+    size_t FirstSegment = 0;
+    size_t SegmentCount = 0;
+    size_t FirstCombinedResult = 0;
+    size_t CombinedResultCount = 0;
+};
+
+// A range of elements of one of the contiguous vectors.
+template <class T>
+class FlatRange
+{
+public:
+    FlatRange(const T* first, size_t count) : m_first(first), m_count(count) {}
+
+    const T* begin() const { return m_first; }
+    const T* end() const { return m_first + m_count; }
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    const T& operator[](size_t index) const { return m_first[index]; }
+    const T& front() const { return m_first[0]; }
+
+private:
+    const T* m_first;
+    size_t m_count;
+};
+
+// Append-only string storage; strings never move once added, so views into it stay valid for its lifetime.
+class StringArena
+{
+public:
+    std::string_view Add(const std::string& text)
+    {
+        if (text.empty())
+        {
+            return std::string_view();
+        }
+        if (m_blocks.empty() || m_used + text.size() > m_blockSize)
+        {
+            auto size = std::max(blockSize, text.size());
+            m_blocks.emplace_back(new char[size]);
+            m_blockSize = size;
+            m_used = 0;
+        }
+        auto data = m_blocks.back().get() + m_used;
+        memcpy(data, text.data(), text.size());
+        m_used += text.size();
+        m_bytes += text.size();
+        return std::string_view(data, text.size());
+    }
+
+    size_t GetBytes() const
+    {
+        return m_bytes;
+    }
+
+private:
+    static constexpr size_t blockSize = 1024 * 1024;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_blockSize = 0;
+    size_t m_used = 0;
+    size_t m_bytes = 0;
+};
+
+class BatchResults
+{
+public:
+    // Parses a result file. Throws std::runtime_error if the JSON is malformed.
+    static std::unique_ptr<BatchResults> Parse(const std::string& json)
+    {
+        std::unique_ptr<BatchResults> results(new BatchResults());
+        Builder builder(*results);
+        nlohmann::json::sax_parse(json, &builder);
+        return results;
+    }
+
+    FlatRange<FlatAudioFile> AudioFiles() const
+    {
+        return FlatRange<FlatAudioFile>(m_audioFiles.data(), m_audioFiles.size());
+    }
+
+    FlatRange<FlatSegment> Segments(const FlatAudioFile& audioFile) const
+    {
+        return FlatRange<FlatSegment>(m_segments.data() + audioFile.FirstSegment, audioFile.SegmentCount);
+    }
+
+    FlatRange<FlatResult> NBest(const FlatSegment& segment) const
+    {
+        return FlatRange<FlatResult>(m_nBest.data() + segment.FirstNBest, segment.NBestCount);
+    }
+
+    FlatRange<FlatResult> CombinedResults(const FlatAudioFile& audioFile) const
+    {
+        return FlatRange<FlatResult>(m_combinedResults.data() + audioFile.FirstCombinedResult, audioFile.CombinedResultCount);
+    }
+
+    // Approximate memory used by the model.
+    size_t GetMemoryBytes() const
+    {
+        return m_strings.GetBytes() + m_audioFiles.capacity() * sizeof(FlatAudioFile) + m_segments.capacity() * sizeof(FlatSegment) +
+            (m_nBest.capacity() + m_combinedResults.capacity()) * sizeof(FlatResult);
+    }
+
+private:
+    BatchResults() = default;
+
+    // SAX handler that fills the model. It tracks where in the document it is with a stack of contexts; everything
+    // outside the known structure (including unknown properties such as "Words") is skipped.
+    class Builder
+    {
+    public:
+        explicit Builder(BatchResults& results) : m_results(results)
+        {
+            m_contexts.push_back(Context::Document);
+        }
+
+        bool null() { return true; }
+        bool boolean(bool) { return true; }
+        bool number_integer(nlohmann::json::number_integer_t value) { return Number((double)value, (uint64_t)value); }
+        bool number_unsigned(nlohmann::json::number_unsigned_t value) { return Number((double)value, value); }
+        bool number_float(nlohmann::json::number_float_t value, const std::string&) { return Number(value, (uint64_t)value); }
+        bool binary(nlohmann::json::binary_t&) { return true; }
+
+        bool string(std::string& value)
+        {
+            auto context = m_contexts.back();
+            if (context == Context::AudioFile && m_key == "AudioFileName")
+            {
+                m_results.m_audioFiles.back().AudioFileName = m_results.m_strings.Add(value);
+            }
+            else if (context == Context::Segment && m_key == "RecognitionStatus")
+            {
+                m_results.m_segments.back().RecognitionStatus = m_results.m_strings.Add(value);
+            }
+            else if (context == Context::NBest || context == Context::CombinedResult)
+            {
+                auto& result = context == Context::NBest ? m_results.m_nBest.back() : m_results.m_combinedResults.back();
+                auto field = m_key == "Lexical" ? &result.Lexical : m_key == "ITN" ? &result.ITN :
+                    m_key == "MaskedITN" ? &result.MaskedITN : m_key == "Display" ? &result.Display : nullptr;
+                if (field != nullptr)
+                {
+                    *field = m_results.m_strings.Add(value);
+                }
+            }
+            return true;
+        }
+
+        bool key(std::string& value)
+        {
+            m_key = value;
+            return true;
+        }
+
+        bool start_object(std::size_t)
+        {
+            auto context = m_contexts.back();
+            auto next = Context::Skip;
+            if (context == Context::Document)
+            {
+                next = Context::Root;
+            }
+            else if (context == Context::AudioFiles)
+            {
+                m_results.m_audioFiles.emplace_back();
+                m_results.m_audioFiles.back().FirstSegment = m_results.m_segments.size();
+                m_results.m_audioFiles.back().FirstCombinedResult = m_results.m_combinedResults.size();
+                next = Context::AudioFile;
+            }
+            else if (context == Context::Segments)
+            {
+                m_results.m_segments.emplace_back();
+                m_results.m_segments.back().FirstNBest = m_results.m_nBest.size();
+                m_results.m_audioFiles.back().SegmentCount++;
+                next = Context::Segment;
+            }
+            else if (context == Context::NBestList)
+            {
+                m_results.m_nBest.emplace_back();
+                m_results.m_segments.back().NBestCount++;
+                next = Context::NBest;
+            }
+            else if (context == Context::CombinedResults)
+            {
+                m_results.m_combinedResults.emplace_back();
+                m_results.m_audioFiles.back().CombinedResultCount++;
+                next = Context::CombinedResult;
+            }
+            m_contexts.push_back(next);
+            return true;
+        }
+
+        bool end_object()
+        {
+            m_contexts.pop_back();
+            return true;
+        }
+
+        bool start_array(std::size_t)
+        {
+            auto context = m_contexts.back();
+            auto next = Context::Skip;
+            if (context == Context::Root && m_key == "AudioFileResults")
+            {
+                next = Context::AudioFiles;
+            }
+            else if (context == Context::AudioFile && m_key == "SegmentResults")
+            {
+                next = Context::Segments;
+            }
+            else if (context == Context::AudioFile && m_key == "CombinedResults")
+            {
+                next = Context::CombinedResults;
+            }
+            else if (context == Context::Segment && m_key == "NBest")
+            {
+                next = Context::NBestList;
+            }
+            m_contexts.push_back(next);
+            return true;
+        }
+
+        bool end_array()
+        {
+            m_contexts.pop_back();
+            return true;
+        }
+
+        bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e)
+        {
+            throw std::runtime_error("Invalid result JSON at byte " + std::to_string(position) + ": " + e.what());
+        }
+
+    private:
+        enum class Context { Document, Root, AudioFiles, AudioFile, Segments, Segment, NBestList, NBest, CombinedResults, CombinedResult, Skip };
+
+        bool Number(double value, uint64_t unsignedValue)
+        {
+            auto context = m_contexts.back();
+            if (context == Context::Segment && m_key == "Offset")
+            {
+                m_results.m_segments.back().Offset = unsignedValue;
+            }
+            else if (context == Context::Segment && m_key == "Duration")
+            {
+                m_results.m_segments.back().Duration = unsignedValue;
+            }
+            else if (context == Context::NBest && m_key == "Confidence")
+            {
+                m_results.m_nBest.back().Confidence = value;
+            }
+            return true;
+        }
+
+        BatchResults& m_results;
+        std::vector<Context> m_contexts;
+        std::string m_key;
+    };
+
+    StringArena m_strings;
+    std::vector<FlatAudioFile> m_audioFiles;
+    std::vector<FlatSegment> m_segments;
+    std::vector<FlatResult> m_nBest;
+    std::vector<FlatResult> m_combinedResults;
+};
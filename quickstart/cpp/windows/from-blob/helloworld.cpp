@@ -7,22 +7,39 @@
 #include <iostream>
 #include <strstream>
 #include <Windows.h>
+#include <bcrypt.h>
 #include <locale>
 #include <codecvt>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <queue>
+#include <tuple>
+#include <vector>
 
 #include <cpprest/http_client.h>
+#include <cpprest/http_listener.h>
 #include <cpprest/filestream.h>
 #include <nlohmann/json.hpp>
+#include "batch_results.h"
 
 using namespace std;
 using namespace utility;                    // Common utilities like string conversions
 using namespace web;                        // Common features like URIs.
 using namespace web::http;                  // Common HTTP functionality
 using namespace web::http::client;          // HTTP client features
+using namespace web::http::experimental::listener; // HTTP server features
 using namespace concurrency::streams;       // Asynchronous streams
 using json = nlohmann::json;
 
+#pragma comment(lib, "bcrypt.lib")
+
 const string_t region = U("YourServiceRegion");
 const string_t subscriptionKey = U("YourSubscriptionKey");
 const string name = "Simple transcription";
@@ -30,6 +47,16 @@ const string description = "Simple transcription description";
 const string myLocale = "en-US";
 const string recordingsBlobUri = "YourFileUrl";
 
+// To be notified of completed transcriptions instead of polling for them, set callbackUrl to a public URL that reaches
+// listenUrl on this machine (e.g. through a reverse proxy or tunnel). With an empty callbackUrl, the status is polled.
+// Run the quickstart with --self-test to check the callback receiver locally, without the service.
+const string_t callbackUrl = U("");
+const string_t listenUrl = U("http://localhost:8080/speechtotext/callback");
+
+// Web hooks only exist in the v3.0 API, while the transcription is created through v2.0 (its results are in the v2.0
+// format that BatchResults parses).
+const string_t webHookServiceUrl = U("https://") + region + U(".api.cognitive.microsoft.com/speechtotext/v3.0/");
+
 class TranscriptionDefinition {
 private:
     TranscriptionDefinition(string name,
@@ -119,75 +146,376 @@ void from_json(const nlohmann::json& j, Transcription& t) {
     j.at("status").get_to(t.status);
     t.statusMessage = j.value("statusMessage", "");
 }
-class Result
+
+// Downloads the results of all channels concurrently: one http_client (and with it one connection pool) per host,
+// all requests in flight at once, and every response parsed as soon as it arrives.
+// Returns the results by channel number ("channel_1" is channel 1).
+map<int, shared_ptr<BatchResults>> retrieveResults(const map<string, string>& resultsUrls)
 {
-public:
-    string Lexical;
-    string ITN;
-    string MaskedITN;
-    string Display;
-};
-void from_json(const nlohmann::json& j, Result& r) {
-    j.at("Lexical").get_to(r.Lexical);
-    j.at("ITN").get_to(r.ITN);
-    j.at("MaskedITN").get_to(r.MaskedITN);
-    j.at("Display").get_to(r.Display);
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t >> converter;
+
+    map<string_t, shared_ptr<http_client>> clients;
+    vector<pplx::task<pair<int, shared_ptr<BatchResults>>>> downloads;
+    for (const auto& resultsUrl : resultsUrls)
+    {
+        if (resultsUrl.first.compare(0, 8, "channel_") != 0)
+        {
+            continue;
+        }
+        auto channel = stoi(resultsUrl.first.substr(resultsUrl.first.rfind('_') + 1));
+        uri resultUri(converter.from_bytes(resultsUrl.second));
+
+        auto& client = clients[resultUri.authority().to_string()];
+        if (!client)
+        {
+            client = make_shared<http_client>(resultUri.authority());
+        }
+
+        http_request resultMessage(methods::GET);
+        resultMessage.set_request_uri(resultUri.resource());
+        resultMessage.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+
+        downloads.push_back(client->request(resultMessage)
+            .then([channel](http_response resultResponse)
+            {
+                if (resultResponse.status_code() != status_codes::OK)
+                {
+                    throw runtime_error("Fetching the results of channel " + to_string(channel) + " returned unexpected http code " + to_string(resultResponse.status_code()));
+                }
+                return resultResponse.extract_utf8string(true);
+            })
+            .then([channel](const string& resultBody)
+            {
+                return make_pair(channel, shared_ptr<BatchResults>(BatchResults::Parse(resultBody)));
+            }));
+    }
+
+    map<int, shared_ptr<BatchResults>> results;
+    for (auto& result : pplx::when_all(downloads.begin(), downloads.end()).get())
+    {
+        results[result.first] = move(result.second);
+    }
+    return results;
 }
 
-class NBest : public Result
+// One segment of the merged transcript, attributed to the speaker on its channel.
+struct TranscriptSegment
 {
-public:
-    double Confidence;
+    int Channel;
+    const BatchResults* Results;
+    const FlatSegment* Segment;
 };
-void from_json(const nlohmann::json& j, NBest& nb) {
-    j.at("Confidence").get_to(nb.Confidence);
-    j.at("Lexical").get_to(nb.Lexical);
-    j.at("ITN").get_to(nb.ITN);
-    j.at("MaskedITN").get_to(nb.MaskedITN);
-    j.at("Display").get_to(nb.Display);
-}
 
-class SegmentResult
+// Merges the segments of all channels into one transcript ordered by offset, with a k-way merge over the channels.
+vector<TranscriptSegment> mergeChannels(const map<int, shared_ptr<BatchResults>>& results)
 {
-public:
-    string RecognitionStatus;
-    ULONG Offset;
-    ULONG Duration;
-    std::list<NBest> NBest;
-};
-void from_json(const nlohmann::json& j, SegmentResult& sr) {
-    j.at("RecognitionStatus").get_to(sr.RecognitionStatus);
-    j.at("Offset").get_to(sr.Offset);
-    j.at("Duration").get_to(sr.Duration);
-    sr.NBest = j.at("NBest").get<list<NBest>>();
+    // The segments of each channel, ordered by offset.
+    vector<vector<TranscriptSegment>> channels;
+    for (const auto& result : results)
+    {
+        channels.emplace_back();
+        for (const auto& audioFile : result.second->AudioFiles())
+        {
+            for (const auto& segment : result.second->Segments(audioFile))
+            {
+                channels.back().push_back({ result.first, result.second.get(), &segment });
+            }
+        }
+        stable_sort(channels.back().begin(), channels.back().end(), [](const TranscriptSegment& a, const TranscriptSegment& b)
+        {
+            return a.Segment->Offset < b.Segment->Offset;
+        });
+    }
+
+    // The heap holds the next segment of every channel as (offset, channel index, position); the smallest offset is on top.
+    typedef tuple<uint64_t, size_t, size_t> HeapEntry;
+    priority_queue<HeapEntry, vector<HeapEntry>, greater<HeapEntry>> heap;
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        if (!channels[i].empty())
+        {
+            heap.emplace(channels[i][0].Segment->Offset, i, 0);
+        }
+    }
+
+    vector<TranscriptSegment> transcript;
+    while (!heap.empty())
+    {
+        auto channelIndex = get<1>(heap.top());
+        auto position = get<2>(heap.top());
+        heap.pop();
+
+        transcript.push_back(channels[channelIndex][position]);
+        if (++position < channels[channelIndex].size())
+        {
+            heap.emplace(channels[channelIndex][position].Segment->Offset, channelIndex, position);
+        }
+    }
+    return transcript;
 }
 
-class AudioFileResult
+// HMAC-SHA256 of 'data' with 'key', as the service computes it for the X-MicrosoftSpeechServices-Signature header.
+static vector<unsigned char> hmacSha256(const string& key, const string& data)
 {
-public:
-    string AudioFileName;
-    std::list<SegmentResult> SegmentResults;
-    std::list<Result> CombinedResults;
-};
-void from_json(const nlohmann::json& j, AudioFileResult& arf) {
-    j.at("AudioFileName").get_to(arf.AudioFileName);
-    arf.SegmentResults = j.at("SegmentResults").get<list<SegmentResult>>();
-    arf.CombinedResults = j.at("CombinedResults").get<list<Result>>();
+    BCRYPT_ALG_HANDLE algorithm = nullptr;
+    BCRYPT_HASH_HANDLE hash = nullptr;
+    vector<unsigned char> digest(32);
+    bool succeeded = BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG)) &&
+        BCRYPT_SUCCESS(BCryptCreateHash(algorithm, &hash, nullptr, 0, (PUCHAR)key.data(), (ULONG)key.size(), 0)) &&
+        BCRYPT_SUCCESS(BCryptHashData(hash, (PUCHAR)data.data(), (ULONG)data.size(), 0)) &&
+        BCRYPT_SUCCESS(BCryptFinishHash(hash, digest.data(), (ULONG)digest.size(), 0));
+    if (hash != nullptr)
+    {
+        BCryptDestroyHash(hash);
+    }
+    if (algorithm != nullptr)
+    {
+        BCryptCloseAlgorithmProvider(algorithm, 0);
+    }
+    if (!succeeded)
+    {
+        throw runtime_error("Computing the HMAC-SHA256 of a callback failed.");
+    }
+    return digest;
 }
 
-class RootObject {
+// Receives the transcription completion callbacks of the service and wakes up the waiter of the completed transcription.
+// The web hook is registered with a random secret, and callbacks whose signature does not match it are rejected.
+class CompletionNotifier
+{
 public:
-    std::list<AudioFileResult> AudioFileResults;
+    CompletionNotifier(const string_t& url) : m_listener(url)
+    {
+        unsigned char random[32];
+        if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr, random, sizeof(random), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+        {
+            throw runtime_error("Generating the web hook secret failed.");
+        }
+        static const char* hexDigits = "0123456789abcdef";
+        for (auto b : random)
+        {
+            m_secret += hexDigits[b >> 4];
+            m_secret += hexDigits[b & 15];
+        }
+
+        m_listener.support(methods::POST, [this](http_request request) { handlePost(request); });
+        m_listener.open().wait();
+    }
+
+    ~CompletionNotifier()
+    {
+        try
+        {
+            unregisterWebHook();
+        }
+        catch (const exception& e)
+        {
+            cout << "Deleting the web hook failed: " << e.what() << endl;
+        }
+        m_listener.close().wait();
+    }
+
+    // Registers a web hook for transcription completions with the service; the destructor deletes it again.
+    // The service validates the hook asynchronously, see waitForValidation().
+    void registerWebHook(const string_t& webUrl)
+    {
+        http_client client(webHookServiceUrl);
+        http_request msg(methods::POST);
+        msg.set_request_uri(U("webhooks"));
+        msg.headers().add(U("Content-Type"), U("application/json"));
+        msg.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t >> converter;
+        nlohmann::json webHook = {
+            { "displayName", name + " completion callback" },
+            { "webUrl", converter.to_bytes(webUrl) },
+            { "events", { { "transcriptionCompletion", true } } },
+            { "properties", { { "secret", m_secret } } }
+        };
+        msg.set_body(webHook.dump());
+
+        auto response = client.request(msg).get();
+        if (response.status_code() != status_codes::Created)
+        {
+            throw runtime_error("Registering the web hook returned unexpected http code " + to_string(response.status_code()));
+        }
+        m_webHookLocation = response.headers()[U("location")];
+    }
+
+    void unregisterWebHook()
+    {
+        if (!m_webHookLocation.empty())
+        {
+            http_client client(m_webHookLocation);
+            http_request msg(methods::DEL);
+            msg.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+            client.request(msg).wait();
+            m_webHookLocation.clear();
+        }
+    }
+
+    // Waits until the service has validated the web hook, or until the timeout. Returns true if it has; completions are
+    // only signalled from then on.
+    bool waitForValidation(chrono::milliseconds timeout)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        return m_completed.wait_for(lock, timeout, [this]() { return m_validated; });
+    }
+
+    bool isValidated()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        return m_validated;
+    }
+
+    // Returns true if the transcription with the given v2.0 id is known to the v3.0 API under the same id, which is the
+    // id its completion callback refers to. Only then can waitForCompletion() be woken up for it.
+    bool canNotify(const string& id)
+    {
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t >> converter;
+        http_client client(webHookServiceUrl);
+        http_request msg(methods::GET);
+        msg.set_request_uri(U("transcriptions/") + converter.from_bytes(id));
+        msg.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+        return client.request(msg).get().status_code() == status_codes::OK;
+    }
+
+    // Waits until the transcription with the given id has completed, or until the timeout. Returns true if it has
+    // completed; the completion is consumed, so a later wait for the same id waits for the timeout again.
+    bool waitForCompletion(const string& id, chrono::milliseconds timeout)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if (!m_completed.wait_for(lock, timeout, [this, &id]() { return m_completedIds.count(id) != 0; }))
+        {
+            return false;
+        }
+        m_completedIds.erase(id);
+        return true;
+    }
+
+    // The value of the X-MicrosoftSpeechServices-Signature header of a genuine callback with the given body.
+    string_t signature(const string& body) const
+    {
+        return utility::conversions::to_base64(hmacSha256(m_secret, body));
+    }
+
+private:
+    void handlePost(http_request request)
+    {
+        // The service validates a new web hook by posting a validation token, which must be echoed back.
+        auto query = uri::split_query(request.request_uri().query());
+        auto validationToken = query.find(U("validationToken"));
+        if (validationToken != query.end())
+        {
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_validated = true;
+                m_completed.notify_all();
+            }
+            request.reply(status_codes::OK, validationToken->second);
+            return;
+        }
+
+        request.extract_utf8string(true).then([this, request](const string& body)
+        {
+            // Only callbacks signed with the secret of the web hook are accepted; the comparison takes the same time
+            // wherever the signatures differ.
+            auto expected = signature(body);
+            auto received = request.headers().has(U("X-MicrosoftSpeechServices-Signature")) ?
+                request.headers().find(U("X-MicrosoftSpeechServices-Signature"))->second : string_t();
+            unsigned int difference = received.size() == expected.size() ? 0 : 1;
+            for (size_t i = 0; i < received.size() && i < expected.size(); i++)
+            {
+                difference |= (unsigned int)(received[i] ^ expected[i]);
+            }
+            if (difference != 0)
+            {
+                request.reply(status_codes::Unauthorized);
+                return;
+            }
+
+            // The callback refers to the transcription by its URL, which ends with the transcription id.
+            auto callback = nlohmann::json::parse(body, nullptr, false);
+            if (callback.is_object() && callback.contains("self"))
+            {
+                string self = callback["self"];
+                lock_guard<mutex> lock(m_mutex);
+                m_completedIds.insert(self.substr(self.rfind('/') + 1));
+                m_completed.notify_all();
+            }
+            request.reply(status_codes::OK);
+        });
+    }
+
+    http_listener m_listener;
+    string m_secret;
+    string_t m_webHookLocation;
+    mutex m_mutex;
+    condition_variable m_completed;
+    bool m_validated = false;
+    set<string> m_completedIds;
 };
-void from_json(const nlohmann::json& j, RootObject& r) {
-    r.AudioFileResults = j.at("AudioFileResults").get<list<AudioFileResult>>();
-}
 
+// Checks CompletionNotifier against a local stand-in for the service, which posts a validation request, a callback
+// without a valid signature and a signed callback to listenUrl. Returns true if the notifier behaved as expected.
+bool selfTestCompletionNotifier()
+{
+    CompletionNotifier notifier(listenUrl);
+    http_client client(listenUrl);
+    auto post = [&client](const string_t& query, const string& body, const string_t& signature)
+    {
+        http_request msg(methods::POST);
+        msg.set_request_uri(query);
+        msg.set_body(body, "application/json");
+        if (!signature.empty())
+        {
+            msg.headers().add(U("X-MicrosoftSpeechServices-Signature"), signature);
+        }
+        return client.request(msg).get();
+    };
+
+    bool passed = true;
+    auto check = [&passed](bool condition, const char* what)
+    {
+        cout << (condition ? "PASS: " : "FAIL: ") << what << endl;
+        passed = passed && condition;
+    };
+
+    auto validation = post(U("?validationToken=selftest-token"), "", U(""));
+    check(validation.status_code() == status_codes::OK && validation.extract_string().get() == U("selftest-token"), "the validation token is echoed");
+    check(notifier.waitForValidation(chrono::milliseconds(0)), "the web hook counts as validated");
+
+    const string body = "{\"self\":\"https://localhost/speechtotext/v3.0/transcriptions/selftest-id\"}";
+    auto forged = post(U(""), body, U("c2lnbmF0dXJl"));
+    check(forged.status_code() == status_codes::Unauthorized, "a callback with a wrong signature is rejected");
+    check(!notifier.waitForCompletion("selftest-id", chrono::milliseconds(100)), "a rejected callback does not complete the transcription");
+
+    auto start = chrono::steady_clock::now();
+    auto genuine = post(U(""), body, notifier.signature(body));
+    auto completed = notifier.waitForCompletion("selftest-id", chrono::seconds(5));
+    auto latency = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    check(genuine.status_code() == status_codes::OK && completed, "a signed callback completes the transcription");
+    check(!notifier.waitForCompletion("selftest-id", chrono::milliseconds(0)), "a completion wakes up only one wait");
+    cout << "Callback to wake-up latency: " << latency << " ms" << endl;
+    return passed;
+}
 
 void recognizeSpeech()
 {
     std::wstring_convert<std::codecvt_utf8_utf16<wchar_t >> converter;
 
+    // The web hook is registered before the transcription is created, so that the completion of a short job is not missed.
+    unique_ptr<CompletionNotifier> notifier;
+    if (!callbackUrl.empty())
+    {
+        notifier.reset(new CompletionNotifier(listenUrl));
+        notifier->registerWebHook(callbackUrl);
+        if (!notifier->waitForValidation(chrono::seconds(10)))
+        {
+            cout << "The web hook has not been validated yet; polling the status until it is." << endl;
+        }
+    }
+
     utility::string_t service_url = U("https://") + region + U(".cris.ai/api/speechtotext/v2.0/Transcriptions/");
     uri u(service_url);
 
@@ -215,11 +543,29 @@ void recognizeSpeech()
 
     cout << "Transcription status is located at " << converter.to_bytes(transcriptionLocation) << endl;
 
+    auto transcriptionId = converter.to_bytes(transcriptionLocation.substr(transcriptionLocation.rfind(U('/')) + 1));
+
+    // The callback of the v3.0 web hook names the transcription by its v3.0 id; check that it is the id of the v2.0
+    // location before relying on it.
+    if (notifier && !notifier->canNotify(transcriptionId))
+    {
+        cout << "The transcription is not visible to the web hook; polling the status instead." << endl;
+        notifier.reset();
+    }
+
+    // Without a validated web hook, the status is polled at intervals that start short and grow, since short jobs
+    // finish quickly. Once the hook is validated, the status is checked as soon as the completion callback arrives, and
+    // otherwise only rarely as a safety net. If the status is not final yet after the callback, it is polled again.
+    auto pollInterval = chrono::milliseconds(1000);
+    const auto maxPollInterval = chrono::milliseconds(30000);
+    const auto safetyNetInterval = chrono::milliseconds(60000);
+
     http_client statusCheckClient(transcriptionLocation);
     http_request statusCheckMessage(methods::GET);
     statusCheckMessage.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
 
     bool completed = false;
+    bool notified = false;
 
     while (!completed)
     {
@@ -245,41 +591,26 @@ void recognizeSpeech()
         {
             completed = true;
             cout << "Success!" << endl;
-            string result = transcriptionStatus.resultsUrls["channel_0"];
-            cout << "Transcription has completed. Results are at " << result << endl;
-            cout << "Fetching results" << endl;
+            cout << "Transcription has completed. Fetching the results of " << transcriptionStatus.resultsUrls.size() << " channel(s)" << endl;
 
-            http_client result_client(converter.from_bytes(result));
-            http_request resultMessage(methods::GET);
-            resultMessage.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
-
-            auto resultResponse = result_client.request(resultMessage).get();
-
-            auto responseCode = resultResponse.status_code();
-
-            if (responseCode != status_codes::OK)
+            // The results of a channel are not paged (API v2.0), so one request per channel fetches everything.
+            auto results = retrieveResults(transcriptionStatus.resultsUrls);
+            for (const auto& result : results)
             {
-                cout << "Fetching the transcription returned unexpected http code " << responseCode << endl;
-                return;
+                for (const auto& af : result.second->AudioFiles())
+                {
+                    cout << "There were " << af.SegmentCount << " results in " << af.AudioFileName << " on channel " << result.first << endl;
+                }
             }
 
-            auto resultBody = resultResponse.extract_string().get();
-
-            nlohmann::json resultJSON = nlohmann::json::parse(resultBody);
-            RootObject root = resultJSON;
-
-            for (AudioFileResult af : root.AudioFileResults)
+            // Each channel is one speaker (e.g. agent and customer of a stereo call recording).
+            for (const auto& merged : mergeChannels(results))
             {
-                cout << "There were " << af.SegmentResults.size() << " results in " << af.AudioFileName << endl;
-
-                for (SegmentResult segResult : af.SegmentResults)
+                const auto& segResult = *merged.Segment;
+                auto nBest = merged.Results->NBest(segResult);
+                if (segResult.RecognitionStatus.size() == 7 && !_strnicmp(segResult.RecognitionStatus.data(), "success", 7) && !nBest.empty())
                 {
-                    cout << "Status: " << segResult.RecognitionStatus << endl;
-
-                    if (!_stricmp(segResult.RecognitionStatus.c_str(), "success") && segResult.NBest.size() > 0)
-                    {
-                        cout << "Best text result was: '" << segResult.NBest.front().Display << "'" << endl;
-                    }
+                    cout << "[" << segResult.Offset / 10000000.0 << " s] Speaker " << merged.Channel << ": '" << nBest.front().Display << "'" << endl;
                 }
             }
         }
@@ -293,14 +624,42 @@ void recognizeSpeech()
         }
 
         if (!completed) {
-            Sleep(5000);
+            if (notifier && notifier->isValidated() && !notified)
+            {
+                notified = notifier->waitForCompletion(transcriptionId, safetyNetInterval);
+            }
+            else
+            {
+                if (notifier)
+                {
+                    notifier->waitForCompletion(transcriptionId, pollInterval);
+                }
+                else
+                {
+                    this_thread::sleep_for(pollInterval);
+                }
+                pollInterval = min(pollInterval * 2, maxPollInterval);
+            }
         }
 
     }
 }
 
-int wmain()
+int wmain(int argc, wchar_t** argv)
 {
+    if (argc > 1 && wstring(argv[1]) == L"--self-test")
+    {
+        try
+        {
+            return selfTestCompletionNotifier() ? 0 : 1;
+        }
+        catch (exception e)
+        {
+            cout << e.what() << endl;
+            return 1;
+        }
+    }
+
     try
     {
         recognizeSpeech();
@@ -0,0 +1,316 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Benchmark runner for the client-side audio stages used by the console samples.
+// For every stage it reports the wall-clock time and, where the kernel allows it, hardware counters
+// (cycles, instructions, cache misses, branch misses), all normalized per second of processed audio, or per file
+// open for the stages whose cost does not depend on the length of the audio.
+//
+// Usage: audio_pipeline_benchmark [--iterations N] [--json results.json] [file.wav ...]
+//
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "wav_file_reader.h"
+#include "pcm_format.h"
+#include "beamformer.h"
+#include "audio_preflight.h"
+#include "perf_counters.h"
+
+using namespace std;
+
+namespace
+{
+    // What the results of a stage are normalized by.
+    const string audioSecond = "audio-s";
+    const string fileOpen = "open";
+
+    struct StageResult
+    {
+        string Stage;
+        string File;
+        string Unit;
+        double Units = 0;
+        double WallSeconds = 0;
+        PerfCounterValues Counters;
+    };
+
+    // Runs 'body' 'iterations' times under the counters. 'body' returns how many units (audio seconds or file opens)
+    // it processed.
+    StageResult RunStage(const string& stage, const string& file, const string& unit, int iterations, PerfCounterGroup& counters, const function<double()>& body)
+    {
+        StageResult result;
+        result.Stage = stage;
+        result.File = file;
+        result.Unit = unit;
+
+        // Warm up the page cache and the allocator once before measuring.
+        body();
+
+        auto start = chrono::steady_clock::now();
+        counters.Start();
+        for (int i = 0; i < iterations; i++)
+        {
+            result.Units += body();
+        }
+        result.Counters = counters.Stop();
+        result.WallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // Reads the whole data chunk of a wav file in 'chunkSize' pieces, the way the pull stream callbacks do.
+    double ReadWholeFile(const string& file, uint32_t chunkSize)
+    {
+        WavFileReader reader(file);
+        vector<uint8_t> buffer(chunkSize);
+        uint64_t total = 0;
+        int read = 0;
+        while ((read = reader.Read(buffer.data(), chunkSize)) != 0)
+        {
+            total += read;
+        }
+        return (double)total / reader.GetFormat().AvgBytesPerSec;
+    }
+
+    // Reads the whole audio of a wav file of any supported sample format as interleaved 16-bit samples.
+    vector<int16_t> ReadInt16Samples(const string& file, WavFileReader::WAVEFORMAT* format)
+    {
+        Int16WavFileReader reader(file);
+        *format = reader.GetFormat();
+        vector<int16_t> samples((size_t)reader.GetFrameCount() * format->Channels);
+        auto data = (uint8_t*)samples.data();
+        size_t size = samples.size() * sizeof(int16_t);
+        size_t total = 0;
+        int read = 0;
+        while (total < size && (read = reader.Read(data + total, (uint32_t)min<size_t>(size - total, 32000))) != 0)
+        {
+            total += read;
+        }
+        samples.resize(total / sizeof(int16_t));
+        return samples;
+    }
+
+    // Encodes 16-bit samples as 32-bit IEEE float and as 24-bit PCM, the formats converted by pcm_format.h that the
+    // sample files do not come in.
+    vector<uint8_t> EncodeFloat32(const vector<int16_t>& samples)
+    {
+        vector<uint8_t> encoded(samples.size() * sizeof(float));
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            float value = samples[i] / 32768.0f;
+            memcpy(encoded.data() + i * sizeof(float), &value, sizeof(float));
+        }
+        return encoded;
+    }
+
+    vector<uint8_t> EncodeInt24(const vector<int16_t>& samples)
+    {
+        vector<uint8_t> encoded(samples.size() * 3);
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            auto value = (uint16_t)samples[i];
+            encoded[i * 3] = 0;
+            encoded[i * 3 + 1] = (uint8_t)value;
+            encoded[i * 3 + 2] = (uint8_t)(value >> 8);
+        }
+        return encoded;
+    }
+
+    double PerUnit(double value, double units)
+    {
+        return units > 0 ? value / units : 0;
+    }
+
+    void PrintResult(const StageResult& r, bool countersAvailable)
+    {
+        printf("%-24s %-28s %-8s %10.3f", r.Stage.c_str(), r.File.c_str(), r.Unit.c_str(), PerUnit(r.WallSeconds * 1e6, r.Units));
+        if (r.Unit == audioSecond)
+        {
+            printf(" %14.1f", r.WallSeconds > 0 ? r.Units / r.WallSeconds : 0);
+        }
+        else
+        {
+            printf(" %14s", "-");
+        }
+        if (countersAvailable)
+        {
+            printf(" %14.0f %14.0f %12.1f %12.1f",
+                PerUnit(r.Counters.Cycles, r.Units),
+                PerUnit(r.Counters.Instructions, r.Units),
+                PerUnit(r.Counters.CacheMisses, r.Units),
+                PerUnit(r.Counters.BranchMisses, r.Units));
+        }
+        printf("\n");
+    }
+
+    void WriteJson(const string& fileName, const vector<StageResult>& results, bool countersAvailable)
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        if (!out.good())
+        {
+            throw runtime_error("Failed to open the JSON output file for writing.");
+        }
+
+        out << "{\"countersAvailable\":" << (countersAvailable ? "true" : "false") << ",\"stages\":[\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto& r = results[i];
+            out << (i == 0 ? "" : ",\n")
+                << "{\"stage\":\"" << r.Stage << "\",\"file\":\"" << r.File << "\""
+                << ",\"unit\":\"" << r.Unit << "\""
+                << ",\"units\":" << r.Units
+                << ",\"wallSeconds\":" << r.WallSeconds
+                << ",\"cyclesPerUnit\":" << PerUnit(r.Counters.Cycles, r.Units)
+                << ",\"instructionsPerUnit\":" << PerUnit(r.Counters.Instructions, r.Units)
+                << ",\"cacheMissesPerUnit\":" << PerUnit(r.Counters.CacheMisses, r.Units)
+                << ",\"branchMissesPerUnit\":" << PerUnit(r.Counters.BranchMisses, r.Units)
+                << "}";
+        }
+        out << "\n]}\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 20;
+    string jsonFileName;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc)
+        {
+            iterations = stoi(argv[++i]);
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            jsonFileName = argv[++i];
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty())
+    {
+        files = { "whatstheweatherlike.wav", "katiesteve.wav" };
+    }
+
+    PerfCounterGroup counters;
+    if (!counters.IsAvailable())
+    {
+        cout << "Hardware counters are not available (" << counters.GetError() << "), reporting wall-clock time only." << endl;
+    }
+
+    vector<StageResult> results;
+    try
+    {
+        for (const auto& file : files)
+        {
+            auto fileSeconds = ReadWholeFile(file, 4096);
+            if (fileSeconds <= 0)
+            {
+                cout << "Skipping " << file << ", it holds no audio." << endl;
+                continue;
+            }
+
+            // Opening the file and parsing the RIFF header, as done for every new session; its cost is per open.
+            results.push_back(RunStage("wav-header-parse", file, fileOpen, iterations, counters, [&]()
+            {
+                WavFileReader reader(file);
+                return 1.0;
+            }));
+
+            // Reading the data chunk in the chunk sizes used by the samples (1000 bytes) and by the SDK (100 ms at 16 kHz).
+            // Pushing the data into the SDK's streams is measured by micro_benchmarks (BM_PushData, BM_OutputSinkAppend).
+            for (uint32_t chunkSize : { 1000u, 3200u, 32000u })
+            {
+                results.push_back(RunStage("wav-read-" + to_string(chunkSize), file, audioSecond, iterations, counters, [&]()
+                {
+                    return ReadWholeFile(file, chunkSize);
+                }));
+            }
+
+            // The stages below run in memory on the audio of the file, so that they do not include reading it.
+            WavFileReader::WAVEFORMAT format;
+            auto samples = ReadInt16Samples(file, &format);
+            auto sampleSeconds = (double)samples.size() / format.Channels / format.SamplesPerSec;
+            vector<int16_t> converted(samples.size());
+
+            // Conversion to 16-bit PCM (Int16WavFileReader) of the audio encoded as float and as 24-bit PCM.
+            auto float32 = EncodeFloat32(samples);
+            results.push_back(RunStage("pcm-float32-to-int16", file, audioSecond, iterations, counters, [&]()
+            {
+                PcmToInt16<PcmFloat32>::Convert(float32.data(), converted.data(), converted.size());
+                return sampleSeconds;
+            }));
+            auto int24 = EncodeInt24(samples);
+            results.push_back(RunStage("pcm-int24-to-int16", file, audioSecond, iterations, counters, [&]()
+            {
+                PcmToInt16<PcmInt24>::Convert(int24.data(), converted.data(), converted.size());
+                return sampleSeconds;
+            }));
+
+            // Beamforming (BeamformingWavReader) with the array geometry of the beamforming sample, in blocks of 100 ms,
+            // for files with a channel per microphone.
+            auto geometry = MicrophoneArrayGeometry::Circular(6, 0.0425, true);
+            if (format.Channels >= geometry.Microphones.size())
+            {
+                size_t blockFrames = format.SamplesPerSec / 10;
+                vector<int16_t> mono(blockFrames);
+                results.push_back(RunStage("beamform-7-mic", file, audioSecond, iterations, counters, [&]()
+                {
+                    DelayAndSumBeamformer beamformer(geometry, format.SamplesPerSec, 0);
+                    size_t frames = samples.size() / format.Channels;
+                    for (size_t frame = 0; frame < frames; frame += blockFrames)
+                    {
+                        auto count = min(blockFrames, frames - frame);
+                        beamformer.Process(samples.data() + frame * format.Channels, count, format.Channels, mono.data());
+                    }
+                    return sampleSeconds;
+                }));
+            }
+
+            // The preflight scan run before a session is set up for the file; it reads the file itself.
+            results.push_back(RunStage("preflight-scan", file, audioSecond, iterations, counters, [&]()
+            {
+                return PreflightAudioFile(file).DurationSeconds;
+            }));
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << endl;
+        return 1;
+    }
+
+    printf("%-24s %-28s %-8s %10s %14s", "stage", "file", "per", "us", "x realtime");
+    if (counters.IsAvailable())
+    {
+        printf(" %14s %14s %12s %12s", "cycles/s", "instr/s", "cmiss/s", "bmiss/s");
+    }
+    printf("\n");
+
+    for (const auto& r : results)
+    {
+        PrintResult(r, counters.IsAvailable());
+    }
+
+    if (!jsonFileName.empty())
+    {
+        WriteJson(jsonFileName, results, counters.IsAvailable());
+        cout << "Results were written to " << jsonFileName << endl;
+    }
+
+    return 0;
+}
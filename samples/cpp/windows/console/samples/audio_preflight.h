@@ -0,0 +1,202 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPX_PREFLIGHT_SSE2
+#endif
+
+#include "pcm_format.h"
+
+// What to do with an input file.
+enum class PreflightVerdict
+{
+    Ok,     // Recognize it.
+    Warn,   // Recognize it, but results may be poor (see the issues).
+    Skip,   // Do not start a session: the file is broken or contains no speech.
+};
+
+// Limits used to classify a file.
+struct PreflightThresholds
+{
+    double SilencePeakDbfs = -60;       // Skip: nothing in the file is louder than this.
+    double MinimumSpeechRatio = 0.01;   // Skip: less than this share of the file is speech.
+    double LowSpeechRatio = 0.1;        // Warn.
+    double QuietRmsDbfs = -40;          // Warn: speech is this quiet on average.
+    double ClippingRatio = 0.001;       // Warn: this share of the samples is at full scale.
+};
+
+struct PreflightReport
+{
+    PreflightVerdict Verdict = PreflightVerdict::Ok;
+    std::vector<std::string> Issues;
+    double DurationSeconds = 0;
+    double RmsDbfs = -INFINITY;         // Over the frames detected as speech, or all frames if none.
+    double PeakDbfs = -INFINITY;
+    double ClippingRatio = 0;
+    double SpeechRatio = 0;             // Share of 20 ms frames that are well above the noise floor.
+};
+
+// Checks a wav file before a recognizer is set up for it: header consistency, truncation, level, clipping and
+// whether it contains speech at all. The audio is read once; level statistics are computed per 20 ms frame by a
+// vectorized kernel, so a scan runs at close to disk speed.
+//
+// Speech presence is an energy detector: frames more than 12 dB above the file's noise floor (its 10th percentile
+// frame energy) and above -55 dBFS, or above -40 dBFS in any case, count as speech. It is meant to catch dead air
+// and broken files, not to segment.
+inline PreflightReport PreflightAudioFile(const std::string& audioFileName, const PreflightThresholds& thresholds = PreflightThresholds())
+{
+    PreflightReport report;
+    auto issue = [&report](PreflightVerdict verdict, const std::string& text)
+    {
+        report.Issues.push_back(text);
+        report.Verdict = std::max(report.Verdict, verdict);
+    };
+
+    uint64_t headerFrames = 0;
+    WavFileReader::WAVEFORMAT source;
+    try
+    {
+        WavFileReader reader(audioFileName);
+        source = reader.GetFormat();
+        headerFrames = reader.GetFrameCount();
+        SelectPcmToInt16(reader.GetSampleFormatTag(), source.BitsPerSample);
+    }
+    catch (const std::exception& e)
+    {
+        issue(PreflightVerdict::Skip, e.what());
+        return report;
+    }
+
+    if (source.Channels == 0 || source.SamplesPerSec == 0 || source.BlockAlign != source.Channels * source.BitsPerSample / 8)
+    {
+        issue(PreflightVerdict::Skip, "Inconsistent format header.");
+        return report;
+    }
+    if (source.AvgBytesPerSec != source.SamplesPerSec * source.BlockAlign)
+    {
+        issue(PreflightVerdict::Warn, "Average bytes per second in the header does not match the format.");
+    }
+    if (source.SamplesPerSec != 16000 && source.SamplesPerSec != 8000)
+    {
+        issue(PreflightVerdict::Warn, "Sample rate " + std::to_string(source.SamplesPerSec) + " Hz; the service expects 16 kHz or 8 kHz.");
+    }
+
+    // Per-frame energy, and totals over the file.
+    Int16WavFileReader reader(audioFileName);
+    const size_t frameSamples = source.SamplesPerSec / 50 * source.Channels;
+    std::vector<int16_t> samples(frameSamples);
+    std::vector<double> frameEnergies;
+    uint64_t totalSamples = 0, clippedSamples = 0;
+    int32_t peak = 0;
+    int read = 0;
+    while ((read = reader.Read((uint8_t*)samples.data(), (uint32_t)(samples.size() * sizeof(int16_t)))) > 0)
+    {
+        auto count = (size_t)read / sizeof(int16_t);
+        uint64_t sumOfSquares = 0;
+        size_t i = 0;
+#if defined(SPX_PREFLIGHT_SSE2)
+        auto sums = _mm_setzero_si128(), maxima = _mm_set1_epi16(0), minima = _mm_set1_epi16(0), clipped = _mm_setzero_si128();
+        const auto zero = _mm_setzero_si128(), high = _mm_set1_epi16(32766), low = _mm_set1_epi16(-32767);
+        for (; i + 8 <= count; i += 8)
+        {
+            auto v = _mm_loadu_si128((const __m128i*)(samples.data() + i));
+            // Pairwise sums of squares reach 2^31, so they are widened to 64 bits as unsigned before accumulating.
+            auto squares = _mm_madd_epi16(v, v);
+            sums = _mm_add_epi64(sums, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero), _mm_unpackhi_epi32(squares, zero)));
+            maxima = _mm_max_epi16(maxima, v);
+            minima = _mm_min_epi16(minima, v);
+            // Each full-scale sample sets its lane to -1; subtracting counts it.
+            clipped = _mm_sub_epi16(clipped, _mm_or_si128(_mm_cmpgt_epi16(v, high), _mm_cmplt_epi16(v, low)));
+        }
+        uint64_t sumLanes[2];
+        int16_t maxLanes[8], minLanes[8], clippedLanes[8];
+        _mm_storeu_si128((__m128i*)sumLanes, sums);
+        _mm_storeu_si128((__m128i*)maxLanes, maxima);
+        _mm_storeu_si128((__m128i*)minLanes, minima);
+        _mm_storeu_si128((__m128i*)clippedLanes, clipped);
+        sumOfSquares = sumLanes[0] + sumLanes[1];
+        for (int lane = 0; lane < 8; lane++)
+        {
+            peak = std::max(peak, std::max((int32_t)maxLanes[lane], -(int32_t)minLanes[lane]));
+            clippedSamples += (uint16_t)clippedLanes[lane];
+        }
+#endif
+        for (; i < count; i++)
+        {
+            int32_t sample = samples[i];
+            sumOfSquares += (uint64_t)(sample * sample);
+            peak = std::max(peak, std::abs(sample));
+            clippedSamples += sample > 32766 || sample < -32767 ? 1 : 0;
+        }
+        frameEnergies.push_back((double)sumOfSquares / count);
+        totalSamples += count;
+    }
+
+    auto frames = totalSamples / source.Channels;
+    report.DurationSeconds = (double)frames / source.SamplesPerSec;
+    if (frames == 0)
+    {
+        issue(PreflightVerdict::Skip, "No audio data.");
+        return report;
+    }
+    if (headerFrames != 0 && frames < headerFrames)
+    {
+        issue(PreflightVerdict::Warn, "Truncated: the header announces " + std::to_string((double)headerFrames / source.SamplesPerSec) +
+            " s, the file has " + std::to_string(report.DurationSeconds) + " s.");
+    }
+
+    auto dbfs = [](double energy) { return energy > 0 ? 10 * std::log10(energy / (32768.0 * 32768.0)) : -INFINITY; };
+    report.PeakDbfs = peak > 0 ? 20 * std::log10(peak / 32768.0) : -INFINITY;
+    report.ClippingRatio = (double)clippedSamples / totalSamples;
+
+    auto sorted = frameEnergies;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 10, sorted.end());
+    // Frames above -40 dBFS always count, so continuous speech (with a high floor) is not mistaken for noise.
+    auto threshold = std::max(std::min(dbfs(sorted[sorted.size() / 10]) + 12, -40.0), -55.0);
+    double speechEnergy = 0, allEnergy = 0;
+    size_t speechFrames = 0;
+    for (auto energy : frameEnergies)
+    {
+        allEnergy += energy;
+        if (dbfs(energy) > threshold)
+        {
+            speechEnergy += energy;
+            speechFrames++;
+        }
+    }
+    report.SpeechRatio = (double)speechFrames / frameEnergies.size();
+    report.RmsDbfs = speechFrames > 0 ? dbfs(speechEnergy / speechFrames) : dbfs(allEnergy / frameEnergies.size());
+
+    if (report.PeakDbfs < thresholds.SilencePeakDbfs)
+    {
+        issue(PreflightVerdict::Skip, "Silent: peak level " + std::to_string(report.PeakDbfs) + " dBFS.");
+    }
+    else if (report.SpeechRatio < thresholds.MinimumSpeechRatio)
+    {
+        issue(PreflightVerdict::Skip, "No speech detected.");
+    }
+    else if (report.SpeechRatio < thresholds.LowSpeechRatio)
+    {
+        issue(PreflightVerdict::Warn, "Little speech: " + std::to_string(report.SpeechRatio * 100) + "% of the file.");
+    }
+    if (report.Verdict != PreflightVerdict::Skip && report.RmsDbfs < thresholds.QuietRmsDbfs)
+    {
+        issue(PreflightVerdict::Warn, "Quiet: speech level " + std::to_string(report.RmsDbfs) + " dBFS.");
+    }
+    if (report.ClippingRatio > thresholds.ClippingRatio)
+    {
+        issue(PreflightVerdict::Warn, "Clipped: " + std::to_string(report.ClippingRatio * 100) + "% of the samples are at full scale.");
+    }
+    return report;
+}
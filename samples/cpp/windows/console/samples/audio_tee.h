@@ -0,0 +1,380 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wav_file_reader.h"
+
+// Writes audio to a wav file on a background thread, so that whoever produces the audio (e.g. the audio thread of the
+// Speech SDK) never waits for the disk.
+//
+// Appended bytes go into fixed-size blocks from a pool; only full blocks are handed to the writer thread, so the hot
+// path is a memcpy under an uncontended lock and, once per block, a second short lock. Buffers the caller owns can be queued by reference instead, with
+// no copy at all. Blocks are recycled after they are written, and a new one is allocated only when the writer falls
+// behind, so appending never blocks.
+//
+// The header is written with placeholder sizes and completed by Close(). Space for a 'ds64' chunk is reserved up front
+// (as a 'JUNK' chunk), so an archive that passes 4 GB becomes an RF64 file instead of a broken one.
+//
+// A failed write (e.g. a full disk) does not disturb the producer: the writer stops writing, and Close() throws.
+// Close() may be called from any thread, more than once (e.g. by the SDK through a tee callback and then by the
+// owner); every call returns once the file is complete. Audio appended from then on is ignored, so a producer that
+// may still run when the archive is closed needs no checks of its own.
+class AudioArchiveWriter final
+{
+public:
+    AudioArchiveWriter(const std::string& fileName, const WavFileReader::WAVEFORMAT& format)
+        : m_fileName(fileName), m_format(format)
+    {
+        m_file.open(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to create the audio archive file " + fileName + ".");
+        }
+
+        // RIFF header, reserved space for ds64, format and the start of the data chunk; sizes are filled in on close.
+        char zeros[ds64Size] = {};
+        m_file.write("RIFF\0\0\0\0WAVEJUNK", 16);
+        WriteUInt32(ds64Size);
+        m_file.write(zeros, ds64Size);
+        m_file.write("fmt ", 4);
+        WriteUInt32(sizeof(m_format));
+        m_file.write((const char*)&m_format, sizeof(m_format));
+        m_file.write("data\0\0\0\0", 8);
+
+        m_writer = std::thread([this]() { WriteQueued(); });
+    }
+
+    // Closes the archive if Close() was not called; a write failure is only reported by an explicit Close().
+    ~AudioArchiveWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    // Appends a copy of the audio. Must not be called concurrently with the other Append() overload or itself.
+    void Append(const uint8_t* data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_appendMutex);
+        if (m_appendClosed)
+        {
+            return;
+        }
+        while (size > 0)
+        {
+            if (!m_current)
+            {
+                m_current = TakeBlock();
+            }
+            auto count = std::min(size, blockSize - m_current->size());
+            m_current->insert(m_current->end(), data, data + count);
+            data += count;
+            size -= count;
+            if (m_current->size() == blockSize)
+            {
+                Enqueue(Item{ std::move(m_current), nullptr });
+            }
+        }
+    }
+
+    // Appends audio the caller owns, by reference; the buffer must not change afterwards.
+    void Append(std::shared_ptr<const std::vector<uint8_t>> buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_appendMutex);
+        if (m_appendClosed)
+        {
+            return;
+        }
+        if (m_current)
+        {
+            Enqueue(Item{ std::move(m_current), nullptr });
+        }
+        Enqueue(Item{ nullptr, std::move(buffer) });
+    }
+
+    // Writes what is still queued, completes the header and closes the file; a concurrent or later call waits until
+    // that is done. Throws std::runtime_error if any of the archive could not be written, on this and every later call.
+    void Close()
+    {
+        {
+            // Stops the producer first, so the last partial block can be taken from it.
+            std::unique_lock<std::mutex> appendLock(m_appendMutex);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                appendLock.unlock();
+                m_finalized.wait(lock, [this]() { return m_complete; });
+                ThrowIfFailed();
+                return;
+            }
+            if (m_current)
+            {
+                m_queue.push_back(Item{ std::move(m_current), nullptr });
+            }
+            m_appendClosed = true;
+            m_closed = true;
+        }
+        m_wakeUp.notify_one();
+        m_writer.join();
+
+        // Chunks are word aligned; the pad byte is not part of the data size.
+        if (m_dataBytes % 2 != 0)
+        {
+            m_file.put(0);
+        }
+        auto riffSize = headerSize - 8 + m_dataBytes + m_dataBytes % 2;
+        if (riffSize <= UINT32_MAX)
+        {
+            m_file.seekp(4);
+            WriteUInt32((uint32_t)riffSize);
+            m_file.seekp(headerSize - 4);
+            WriteUInt32((uint32_t)m_dataBytes);
+        }
+        else
+        {
+            // RF64: 32-bit sizes are set to 0xFFFFFFFF and the real ones go into the ds64 chunk in place of JUNK.
+            m_file.seekp(0);
+            m_file.write("RF64", 4);
+            WriteUInt32(UINT32_MAX);
+            m_file.seekp(12);
+            m_file.write("ds64", 4);
+            WriteUInt32(ds64Size);
+            WriteUInt64(riffSize);
+            WriteUInt64(m_dataBytes);
+            WriteUInt64(m_format.BlockAlign == 0 ? 0 : m_dataBytes / m_format.BlockAlign);
+            WriteUInt32(0);
+            m_file.seekp(headerSize - 4);
+            WriteUInt32(UINT32_MAX);
+        }
+        m_file.close();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failed = m_failed || m_file.fail();
+        m_complete = true;
+        m_finalized.notify_all();
+        ThrowIfFailed();
+    }
+
+    // Bytes of audio written to the file so far.
+    uint64_t GetBytesWritten() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dataBytes;
+    }
+
+private:
+    static constexpr size_t blockSize = 64 * 1024;
+    static constexpr uint32_t ds64Size = 28;
+    static constexpr uint64_t headerSize = 12 + 8 + ds64Size + 8 + sizeof(WavFileReader::WAVEFORMAT) + 8;
+
+    // A pooled block or a buffer owned by the caller.
+    struct Item
+    {
+        std::unique_ptr<std::vector<uint8_t>> Block;
+        std::shared_ptr<const std::vector<uint8_t>> Buffer;
+    };
+
+    // Called under the lock.
+    void ThrowIfFailed() const
+    {
+        if (m_failed)
+        {
+            throw std::runtime_error("Failed to write the audio archive " + m_fileName + ".");
+        }
+    }
+
+    std::unique_ptr<std::vector<uint8_t>> TakeBlock()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_freeBlocks.empty())
+            {
+                auto block = std::move(m_freeBlocks.back());
+                m_freeBlocks.pop_back();
+                return block;
+            }
+        }
+        std::unique_ptr<std::vector<uint8_t>> block(new std::vector<uint8_t>());
+        block->reserve(blockSize);
+        return block;
+    }
+
+    // Drops the item if the archive is closed.
+    void Enqueue(Item&& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                return;
+            }
+            m_queue.push_back(std::move(item));
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // The writer thread: writes queued items in order until closed and drained.
+    void WriteQueued()
+    {
+        std::deque<Item> items;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wakeUp.wait(lock, [this]() { return !m_queue.empty() || m_closed; });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            items.swap(m_queue);
+
+            lock.unlock();
+            // Once a write has failed, the stream stays failed and ignores the rest.
+            uint64_t bytes = 0;
+            for (const auto& item : items)
+            {
+                const auto& data = item.Block ? *item.Block : *item.Buffer;
+                m_file.write((const char*)data.data(), data.size());
+                if (m_file.good())
+                {
+                    bytes += data.size();
+                }
+            }
+            auto failed = !m_file.good();
+            lock.lock();
+
+            m_dataBytes += bytes;
+            m_failed = m_failed || failed;
+            for (auto& item : items)
+            {
+                if (item.Block)
+                {
+                    item.Block->clear();
+                    m_freeBlocks.push_back(std::move(item.Block));
+                }
+            }
+            items.clear();
+        }
+    }
+
+    void WriteUInt32(uint32_t value)
+    {
+        uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+        m_file.write((const char*)bytes, sizeof(bytes));
+    }
+
+    void WriteUInt64(uint64_t value)
+    {
+        WriteUInt32((uint32_t)value);
+        WriteUInt32((uint32_t)(value >> 32));
+    }
+
+    std::string m_fileName;
+    WavFileReader::WAVEFORMAT m_format;
+    std::ofstream m_file;
+    std::thread m_writer;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::deque<Item> m_queue;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> m_freeBlocks;
+    std::mutex m_appendMutex;                           // Guards m_current and m_appendClosed.
+    std::unique_ptr<std::vector<uint8_t>> m_current;    // The block being filled by Append().
+    bool m_appendClosed = false;
+    std::condition_variable m_finalized;
+    uint64_t m_dataBytes = 0;
+    bool m_closed = false;
+    bool m_complete = false;    // The file is closed and its header complete.
+    bool m_failed = false;
+};
+
+// Pull audio input stream callback that passes the audio of another callback through to the Speech SDK and keeps a
+// copy of exactly what the SDK read in an archive.
+class TeePullAudioInputStreamCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+{
+public:
+    TeePullAudioInputStreamCallback(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback> source,
+        std::shared_ptr<AudioArchiveWriter> archive)
+        : m_source(source), m_archive(archive)
+    {
+    }
+
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto read = m_source->Read(dataBuffer, size);
+        if (read > 0)
+        {
+            m_archive->Append(dataBuffer, (size_t)read);
+        }
+        return read;
+    }
+
+    // Called by the SDK, which cannot act on a failed archive; the error is left for the owner's archive Close().
+    void Close() override
+    {
+        m_source->Close();
+        try
+        {
+            m_archive->Close();
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+    }
+
+private:
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback> m_source;
+    std::shared_ptr<AudioArchiveWriter> m_archive;
+};
+
+// Writes to a push audio input stream and to an archive.
+class TeePushAudioInputStream final
+{
+public:
+    TeePushAudioInputStream(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> stream,
+        std::shared_ptr<AudioArchiveWriter> archive)
+        : m_stream(stream), m_archive(archive)
+    {
+    }
+
+    void Write(uint8_t* dataBuffer, uint32_t size)
+    {
+        m_stream->Write(dataBuffer, size);
+        m_archive->Append(dataBuffer, size);
+    }
+
+    // Writes a buffer the caller gives up, which the archive keeps by reference instead of copying.
+    void Write(std::shared_ptr<std::vector<uint8_t>> buffer)
+    {
+        m_stream->Write(buffer->data(), (uint32_t)buffer->size());
+        m_archive->Append(std::move(buffer));
+    }
+
+    // Closes the stream, then the archive; throws std::runtime_error if the archive could not be written.
+    void Close()
+    {
+        m_stream->Close();
+        m_archive->Close();
+    }
+
+private:
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> m_stream;
+    std::shared_ptr<AudioArchiveWriter> m_archive;
+};
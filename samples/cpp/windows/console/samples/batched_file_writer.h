@@ -0,0 +1,613 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SPX_HAVE_IO_URING
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+#elif defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct BatchedFileWriterStatistics
+{
+    std::string Backend;        // "io_uring" or "thread pool".
+    uint64_t Submitted = 0;     // Files passed to WriteFile().
+    uint64_t Completed = 0;     // Files written successfully.
+    uint64_t Failed = 0;
+    size_t QueueDepth = 0;      // Files submitted but not finished yet.
+    size_t MaxQueueDepth = 0;
+    uint64_t Batches = 0;       // io_uring submissions; each carries the operations of one or more files.
+    double MeanLatencyMs = 0;   // From WriteFile() to completion.
+    double P99LatencyMs = 0;    // Over the last 1024 files.
+};
+
+// Writes whole files (e.g. synthesized audio, from SpeechSynthesisResult::GetAudioData()) in the background, in batches.
+//
+// Every file is written to "<path>.tmp", flushed to disk (if durable), closed and renamed to its path, so a file
+// either appears complete or not at all. On Linux the four steps of many files are submitted together through
+// io_uring as linked operations, so one system call carries a whole batch and the disk sees many writes and flushes at
+// once. io_uring is used through its system calls directly, without liburing. Where it is unavailable (older kernels,
+// kernels without rename support, blocked by a seccomp policy, other platforms) a thread pool does the same steps.
+//
+// Completion callbacks run on the writer's thread(s) and should return quickly.
+class BatchedFileWriter final
+{
+public:
+    typedef std::function<void(const std::string& path, bool succeeded, const std::string& error)> CompletionCallback;
+
+    explicit BatchedFileWriter(bool durable = true, unsigned ringEntries = 256, unsigned fallbackThreads = 4, bool useIoUring = true)
+        : m_durable(durable)
+    {
+#if defined(SPX_HAVE_IO_URING)
+        if (useIoUring && SetUpRing(ringEntries))
+        {
+            m_threads.emplace_back([this]() { RunRing(); });
+            return;
+        }
+#else
+        (void)ringEntries;
+        (void)useIoUring;
+#endif
+        for (unsigned i = 0; i < std::max(1u, fallbackThreads); i++)
+        {
+            m_threads.emplace_back([this]() { RunThreadPool(); });
+        }
+    }
+
+    ~BatchedFileWriter()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+#if defined(SPX_HAVE_IO_URING)
+        TearDownRing();
+#endif
+    }
+
+    // Queues a file to be written; 'data' must not change until the file is complete.
+    void WriteFile(const std::string& path, std::shared_ptr<const std::vector<uint8_t>> data, CompletionCallback done = nullptr)
+    {
+        std::unique_ptr<Request> request(new Request());
+        request->Path = path;
+        request->TemporaryPath = path + ".tmp";
+        request->Data = std::move(data);
+        request->Done = std::move(done);
+        request->Queued = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(std::move(request));
+            m_statistics.Submitted++;
+            m_statistics.QueueDepth++;
+            m_statistics.MaxQueueDepth = std::max(m_statistics.MaxQueueDepth, m_statistics.QueueDepth);
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // Waits until all files queued so far are finished.
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finished.wait(lock, [this]() { return m_statistics.QueueDepth == 0; });
+    }
+
+    BatchedFileWriterStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.Backend = m_ringFd >= 0 ? "io_uring" : "thread pool";
+        auto finished = statistics.Completed + statistics.Failed;
+        statistics.MeanLatencyMs = finished == 0 ? 0 : m_totalLatencyMs / finished;
+        if (!m_recentLatenciesMs.empty())
+        {
+            auto latencies = m_recentLatenciesMs;
+            auto p99 = latencies.begin() + (latencies.size() * 99) / 100;
+            std::nth_element(latencies.begin(), p99, latencies.end());
+            statistics.P99LatencyMs = *p99;
+        }
+        return statistics;
+    }
+
+private:
+    struct Request
+    {
+        std::string Path;
+        std::string TemporaryPath;
+        std::shared_ptr<const std::vector<uint8_t>> Data;
+        CompletionCallback Done;
+        std::chrono::steady_clock::time_point Queued;
+        int Fd = -1;
+        int Results[4] = {};        // Of the write, flush, close and rename operations.
+        int Outstanding = 0;        // Operations not completed yet.
+        int SubmitError = 0;        // errno of an io_uring_enter() that failed to submit the operations.
+    };
+
+    enum Operation { WriteOperation = 0, FsyncOperation = 1, CloseOperation = 2, RenameOperation = 3 };
+
+    void Finish(std::unique_ptr<Request> request, const std::string& error)
+    {
+        auto latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request->Queued).count();
+        if (request->Done)
+        {
+            request->Done(request->Path, error.empty(), error);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            (error.empty() ? m_statistics.Completed : m_statistics.Failed)++;
+            m_statistics.QueueDepth--;
+            m_totalLatencyMs += latencyMs;
+            if (m_recentLatenciesMs.size() < recentLatencyCount)
+            {
+                m_recentLatenciesMs.push_back(latencyMs);
+            }
+            else
+            {
+                m_recentLatenciesMs[m_nextLatency] = latencyMs;
+            }
+            m_nextLatency = (m_nextLatency + 1) % recentLatencyCount;
+        }
+        m_finished.notify_all();
+    }
+
+    // The fallback: every thread takes one file at a time and writes it with blocking calls.
+    void RunThreadPool()
+    {
+        while (true)
+        {
+            std::unique_ptr<Request> request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeUp.wait(lock, [this]() { return !m_pending.empty() || m_stopping; });
+                if (m_pending.empty())
+                {
+                    return;
+                }
+                request = std::move(m_pending.front());
+                m_pending.pop_front();
+            }
+            auto error = WriteSynchronously(*request);
+            Finish(std::move(request), error);
+        }
+    }
+
+    std::string WriteSynchronously(const Request& request)
+    {
+        const auto& data = *request.Data;
+#if defined(_WIN32)
+        FILE* file = nullptr;
+        if (fopen_s(&file, request.TemporaryPath.c_str(), "wb") != 0 || file == nullptr)
+        {
+            return "Failed to create " + request.TemporaryPath + ".";
+        }
+        bool written = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0 &&
+            (!m_durable || _commit(_fileno(file)) == 0);
+        written = fclose(file) == 0 && written;
+        // rename() does not replace an existing file on Windows; the old file is removed first.
+        std::remove(request.Path.c_str());
+        if (!written || std::rename(request.TemporaryPath.c_str(), request.Path.c_str()) != 0)
+        {
+            std::remove(request.TemporaryPath.c_str());
+            return "Failed to write " + request.Path + ".";
+        }
+        return std::string();
+#else
+        auto fd = open(request.TemporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return "open " + request.TemporaryPath + ": " + strerror(errno);
+        }
+        std::string error;
+        for (size_t written = 0; written < data.size() && error.empty();)
+        {
+            auto result = write(fd, data.data() + written, data.size() - written);
+            if (result < 0 && errno != EINTR)
+            {
+                error = std::string("write: ") + strerror(errno);
+            }
+            written += result > 0 ? (size_t)result : 0;
+        }
+        if (error.empty() && m_durable && fsync(fd) != 0)
+        {
+            error = std::string("fsync: ") + strerror(errno);
+        }
+        if (close(fd) != 0 && error.empty())
+        {
+            error = std::string("close: ") + strerror(errno);
+        }
+        if (error.empty() && rename(request.TemporaryPath.c_str(), request.Path.c_str()) != 0)
+        {
+            error = std::string("rename: ") + strerror(errno);
+        }
+        if (!error.empty())
+        {
+            unlink(request.TemporaryPath.c_str());
+        }
+        return error;
+#endif
+    }
+
+#if defined(SPX_HAVE_IO_URING)
+    // Creates the ring and maps its queues; returns false if io_uring or one of the needed operations is unavailable.
+    bool SetUpRing(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        auto fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // Renames need kernel 5.11; opening, writing, flushing and closing come earlier.
+        std::vector<uint8_t> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto probe = (io_uring_probe*)probeBuffer.data();
+        bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+        for (auto op : { IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_CLOSE, IORING_OP_RENAMEAT })
+        {
+            supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+
+        size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sqSize = cqSize = std::max(sqSize, cqSize);
+        }
+        auto sq = supported ? mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING) : MAP_FAILED;
+        auto cq = sq == MAP_FAILED || (params.features & IORING_FEAT_SINGLE_MMAP) ? sq :
+            mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        auto sqes = cq == MAP_FAILED ? MAP_FAILED :
+            mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            if (cq != MAP_FAILED && cq != sq)
+            {
+                munmap(cq, cqSize);
+            }
+            if (sq != MAP_FAILED)
+            {
+                munmap(sq, sqSize);
+            }
+            close(fd);
+            return false;
+        }
+
+        m_ringFd = fd;
+        m_sqMapping = sq;
+        m_sqMappingSize = sqSize;
+        m_cqMapping = cq;
+        m_cqMappingSize = cqSize;
+        m_sqes = (io_uring_sqe*)sqes;
+        m_sqEntries = params.sq_entries;
+        m_sqHead = (unsigned*)((char*)sq + params.sq_off.head);
+        m_sqTail = (unsigned*)((char*)sq + params.sq_off.tail);
+        m_sqMask = *(unsigned*)((char*)sq + params.sq_off.ring_mask);
+        m_sqArray = (unsigned*)((char*)sq + params.sq_off.array);
+        m_cqHead = (unsigned*)((char*)cq + params.cq_off.head);
+        m_cqTail = (unsigned*)((char*)cq + params.cq_off.tail);
+        m_cqMask = *(unsigned*)((char*)cq + params.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe*)((char*)cq + params.cq_off.cqes);
+
+        // Every file takes up to four entries; at most this many files are in flight, so the queues never overflow.
+        m_slots.resize(m_sqEntries / 4);
+        return true;
+    }
+
+    void TearDownRing()
+    {
+        if (m_ringFd < 0)
+        {
+            return;
+        }
+        munmap(m_sqes, m_sqEntries * sizeof(io_uring_sqe));
+        if (m_cqMapping != m_sqMapping)
+        {
+            munmap(m_cqMapping, m_cqMappingSize);
+        }
+        munmap(m_sqMapping, m_sqMappingSize);
+        close(m_ringFd);
+    }
+
+    io_uring_sqe* NextSqe()
+    {
+        // Only this thread writes the tail; the kernel reads it.
+        auto tail = *m_sqTail;
+        auto index = tail & m_sqMask;
+        auto sqe = &m_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    // Queues the linked operations of one file; a failed operation cancels the ones after it.
+    void Prepare(size_t slot, Request& request)
+    {
+        const Operation operations[] = { WriteOperation, FsyncOperation, CloseOperation, RenameOperation };
+        for (auto operation : operations)
+        {
+            if (operation == FsyncOperation && !m_durable)
+            {
+                continue;
+            }
+            auto sqe = NextSqe();
+            sqe->user_data = slot * 4 + operation;
+            sqe->flags = operation == RenameOperation ? 0 : IOSQE_IO_LINK;
+            switch (operation)
+            {
+            case WriteOperation:
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = request.Fd;
+                sqe->addr = (uint64_t)(uintptr_t)request.Data->data();
+                sqe->len = (uint32_t)request.Data->size();
+                sqe->off = 0;
+                break;
+            case FsyncOperation:
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = request.Fd;
+                break;
+            case CloseOperation:
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = request.Fd;
+                break;
+            case RenameOperation:
+                sqe->opcode = IORING_OP_RENAMEAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (uint64_t)(uintptr_t)request.TemporaryPath.c_str();
+                sqe->len = (uint32_t)AT_FDCWD;
+                sqe->addr2 = (uint64_t)(uintptr_t)request.Path.c_str();
+                break;
+            }
+            request.Outstanding++;
+        }
+    }
+
+    // Checks the results of a file whose operations all completed, and cleans up after a failure.
+    std::string Check(Request& request)
+    {
+        std::string error;
+        if (request.SubmitError != 0)
+        {
+            error = std::string("io_uring_enter: ") + strerror(request.SubmitError);
+        }
+        const char* names[] = { "write", "fsync", "close", "rename" };
+        for (int operation = WriteOperation; operation <= RenameOperation && error.empty(); operation++)
+        {
+            auto result = request.Results[operation];
+            if (result < 0 && result != -ECANCELED)
+            {
+                error = std::string(names[operation]) + ": " + strerror(-result);
+            }
+        }
+        if (error.empty() && request.Results[WriteOperation] != (int)request.Data->size())
+        {
+            error = "write: short write";
+        }
+        if (request.Results[CloseOperation] == -ECANCELED)
+        {
+            close(request.Fd);
+        }
+        if (!error.empty() || request.Results[RenameOperation] != 0)
+        {
+            unlink(request.TemporaryPath.c_str());
+            if (error.empty())
+            {
+                error = "rename: canceled";
+            }
+        }
+        return error;
+    }
+
+    // The io_uring dispatcher: opens the files of a batch, submits their operations with one system call, and reaps
+    // completions, blocking only when there is nothing new to submit.
+    //
+    // The kernel may consume fewer entries than were queued (it runs short of memory, or the completion queue is
+    // full); the rest stay in the ring and go out with the next call. If that cuts a file's linked operations apart,
+    // its remaining operations are canceled rather than run unordered. If io_uring_enter() fails for good, every file
+    // with operations not consumed fails.
+    void RunRing()
+    {
+        std::vector<size_t> freeSlots;
+        for (size_t slot = m_slots.size(); slot > 0; slot--)
+        {
+            freeSlots.push_back(slot - 1);
+        }
+        size_t inFlight = 0;
+
+        // Records the result of an operation, and finishes the file after its last one.
+        auto complete = [this, &freeSlots, &inFlight](uint64_t userData, int result)
+        {
+            auto slot = (size_t)((userData & ~canceledFlag) / 4);
+            auto& request = m_slots[slot];
+            request->Results[userData % 4] = (userData & canceledFlag) != 0 ? -ECANCELED : result;
+            if (--request->Outstanding == 0)
+            {
+                auto error = Check(*request);
+                Finish(std::move(request), error);
+                freeSlots.push_back(slot);
+                inFlight--;
+            }
+        };
+
+        while (true)
+        {
+            std::deque<std::unique_ptr<Request>> batch;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (inFlight == 0)
+                {
+                    m_wakeUp.wait(lock, [this]() { return !m_pending.empty() || m_stopping; });
+                    if (m_pending.empty())
+                    {
+                        return;
+                    }
+                }
+                while (!m_pending.empty() && batch.size() < freeSlots.size())
+                {
+                    batch.push_back(std::move(m_pending.front()));
+                    m_pending.pop_front();
+                }
+            }
+
+            for (auto& request : batch)
+            {
+                // Opening stays synchronous: the later operations need the descriptor.
+                request->Fd = open(request->TemporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (request->Fd < 0)
+                {
+                    auto error = "open " + request->TemporaryPath + ": " + strerror(errno);
+                    Finish(std::move(request), error);
+                    continue;
+                }
+                auto slot = freeSlots.back();
+                freeSlots.pop_back();
+                Prepare(slot, *request);
+                m_slots[slot] = std::move(request);
+                inFlight++;
+            }
+
+            // Submits everything queued in the ring and, if there is nothing to submit, waits for a completion.
+            if (inFlight > 0)
+            {
+                auto head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+                auto queued = *m_sqTail - head;
+                int result;
+                do
+                {
+                    result = (int)syscall(__NR_io_uring_enter, m_ringFd, queued, queued == 0 ? 1u : 0u, IORING_ENTER_GETEVENTS, nullptr, 0);
+                } while (result < 0 && errno == EINTR);
+
+                if (result > 0)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_statistics.Batches++;
+                }
+                if (result >= 0 && (unsigned)result < queued)
+                {
+                    CancelSplitLink(head + (unsigned)result);
+                }
+                else if (result < 0 && errno == EAGAIN)
+                {
+                    // Out of kernel resources until some operations complete.
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                else if (result < 0 && errno != EBUSY)
+                {
+                    // The entries are taken back out of the ring (the kernel only reads up to the tail during a call).
+                    auto error = errno;
+                    for (auto index = head; index != *m_sqTail; index++)
+                    {
+                        const auto& sqe = m_sqes[m_sqArray[index & m_sqMask]];
+                        m_slots[(size_t)((sqe.user_data & ~canceledFlag) / 4)]->SubmitError = error;
+                        complete(sqe.user_data, -ECANCELED);
+                    }
+                    __atomic_store_n(m_sqTail, head, __ATOMIC_RELEASE);
+                }
+            }
+
+            // EBUSY means the completion queue is full; reaping it lets the next call submit.
+            auto head = *m_cqHead;
+            auto tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++)
+            {
+                const auto& cqe = m_cqes[head & m_cqMask];
+                complete(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    // After a partial submission that ended at 'head': if the last consumed entry links to the next one, turns the
+    // rest of that chain into canceled no-ops, so the file is not renamed before its write is done.
+    void CancelSplitLink(unsigned head)
+    {
+        if ((m_sqes[m_sqArray[(head - 1) & m_sqMask]].flags & IOSQE_IO_LINK) == 0)
+        {
+            return;
+        }
+        for (auto index = head; index != *m_sqTail; index++)
+        {
+            auto& sqe = m_sqes[m_sqArray[index & m_sqMask]];
+            auto linked = (sqe.flags & IOSQE_IO_LINK) != 0;
+            auto userData = sqe.user_data | canceledFlag;
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_NOP;
+            sqe.user_data = userData;
+            if (!linked)
+            {
+                break;
+            }
+        }
+    }
+
+    // Marks the user data of an operation that was replaced by a no-op.
+    static constexpr uint64_t canceledFlag = 1ull << 63;
+
+    void* m_sqMapping = nullptr;
+    size_t m_sqMappingSize = 0;
+    void* m_cqMapping = nullptr;
+    size_t m_cqMappingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    unsigned m_sqEntries = 0;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_sqArray = nullptr;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+    std::vector<std::unique_ptr<Request>> m_slots;
+#endif
+
+    static constexpr size_t recentLatencyCount = 1024;
+
+    bool m_durable;
+    int m_ringFd = -1;
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_finished;
+    std::deque<std::unique_ptr<Request>> m_pending;
+    bool m_stopping = false;
+    BatchedFileWriterStatistics m_statistics;
+    double m_totalLatencyMs = 0;
+    std::vector<double> m_recentLatenciesMs;
+    size_t m_nextLatency = 0;
+};
@@ -0,0 +1,277 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SPX_BEAMFORMER_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SPX_BEAMFORMER_NEON
+#endif
+
+#include "pcm_format.h"
+
+// Positions of the microphones of an array, in meters, one per input channel.
+// Channels beyond the listed microphones (e.g. a loudspeaker reference channel) are ignored.
+struct MicrophoneArrayGeometry
+{
+    struct Position
+    {
+        double X;
+        double Y;
+        double Z;
+    };
+    std::vector<Position> Microphones;
+
+    // 'count' microphones evenly spaced on a circle of 'radius' meters, optionally after one in the center.
+    static MicrophoneArrayGeometry Circular(int count, double radius, bool withCenter)
+    {
+        const double pi = 3.14159265358979323846;
+        MicrophoneArrayGeometry geometry;
+        if (withCenter)
+        {
+            geometry.Microphones.push_back(Position{ 0, 0, 0 });
+        }
+        for (int i = 0; i < count; i++)
+        {
+            geometry.Microphones.push_back(Position{ radius * std::cos(2 * pi * i / count), radius * std::sin(2 * pi * i / count), 0 });
+        }
+        return geometry;
+    }
+};
+
+// Delay-and-sum beamformer: steers a microphone array toward a direction by delaying every channel so that sound from
+// that direction lines up across channels, then averages them. Sound from the steered direction adds up coherently,
+// while noise and sound from other directions partly cancel.
+//
+// Delays are rarely whole samples (at 16 kHz one sample is 2 cm of sound travel), so every channel goes through a
+// windowed-sinc fractional-delay filter. The filter taps of all channels are applied as multiply-adds over whole blocks,
+// vectorized with SSE or NEON where available.
+class DelayAndSumBeamformer final
+{
+public:
+    // Steers toward 'azimuthDegrees' (counterclockwise from the x axis) and 'elevationDegrees' (up from the x-y plane).
+    DelayAndSumBeamformer(const MicrophoneArrayGeometry& geometry, uint32_t sampleRate, double azimuthDegrees, double elevationDegrees = 0,
+        double speedOfSound = 343.0)
+        : m_microphones(geometry.Microphones.size())
+    {
+        if (m_microphones == 0)
+        {
+            throw std::invalid_argument("The array geometry has no microphones.");
+        }
+
+        const double pi = 3.14159265358979323846;
+        auto azimuth = azimuthDegrees * pi / 180;
+        auto elevation = elevationDegrees * pi / 180;
+        double direction[3] = { std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation) };
+
+        // Microphones closer to the source hear it earlier, so they are delayed more.
+        std::vector<double> leads;
+        for (const auto& microphone : geometry.Microphones)
+        {
+            leads.push_back(microphone.X * direction[0] + microphone.Y * direction[1] + microphone.Z * direction[2]);
+        }
+        auto earliest = *std::min_element(leads.begin(), leads.end());
+
+        for (size_t i = 0; i < m_microphones; i++)
+        {
+            auto delay = (leads[i] - earliest) / speedOfSound * sampleRate;
+            auto whole = (size_t)std::floor(delay);
+            m_wholeDelays.push_back(whole);
+            m_historyLength = std::max(m_historyLength, whole + filterTaps);
+
+            // Windowed sinc centered on (filterTaps / 2 - 1 + fraction); the constant part is a common latency.
+            auto fraction = delay - whole;
+            std::vector<float> taps(filterTaps);
+            for (size_t k = 0; k < filterTaps; k++)
+            {
+                auto x = (double)k - (filterTaps / 2 - 1) - fraction;
+                auto sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+                auto window = 0.5 - 0.5 * std::cos(2 * pi * (k + 1 - fraction) / filterTaps);
+                taps[k] = (float)(sinc * window / m_microphones);
+            }
+            m_taps.push_back(taps);
+        }
+        m_channels.assign(m_microphones, std::vector<float>(m_historyLength, 0.0f));
+    }
+
+    // Beamforms 'frames' frames of interleaved 16-bit samples with 'channels' channels into 'output' (mono, 16-bit).
+    void Process(const int16_t* input, size_t frames, size_t channels, int16_t* output)
+    {
+        if (channels < m_microphones)
+        {
+            throw std::invalid_argument("The input has fewer channels than the array has microphones.");
+        }
+
+        // Each channel buffer holds the history needed by the delays and filters, followed by the new block.
+        for (size_t c = 0; c < m_microphones; c++)
+        {
+            auto& channel = m_channels[c];
+            channel.resize(m_historyLength + frames);
+            for (size_t n = 0; n < frames; n++)
+            {
+                channel[m_historyLength + n] = input[n * channels + c];
+            }
+        }
+
+        m_sum.assign(frames, 0.0f);
+        for (size_t c = 0; c < m_microphones; c++)
+        {
+            const auto& taps = m_taps[c];
+            auto start = m_channels[c].data() + m_historyLength - m_wholeDelays[c];
+            for (size_t k = 0; k < filterTaps; k++)
+            {
+                MultiplyAdd(m_sum.data(), start - k, taps[k], frames);
+            }
+        }
+
+        for (size_t n = 0; n < frames; n++)
+        {
+            output[n] = (int16_t)std::max(-32768.0f, std::min(32767.0f, std::round(m_sum[n])));
+        }
+
+        // Keeps the end of this block as history for the next one.
+        for (auto& channel : m_channels)
+        {
+            std::copy(channel.end() - m_historyLength, channel.end(), channel.begin());
+            channel.resize(m_historyLength);
+        }
+    }
+
+    // Delay between input and output, in samples.
+    size_t GetLatency() const
+    {
+        return filterTaps / 2 - 1;
+    }
+
+private:
+    static constexpr size_t filterTaps = 16;
+
+    // sum[n] += x[n] * factor for n in [0, count).
+    static void MultiplyAdd(float* sum, const float* x, float factor, size_t count)
+    {
+        size_t n = 0;
+#if defined(SPX_BEAMFORMER_SSE)
+        auto f = _mm_set1_ps(factor);
+        for (; n + 4 <= count; n += 4)
+        {
+            _mm_storeu_ps(sum + n, _mm_add_ps(_mm_loadu_ps(sum + n), _mm_mul_ps(_mm_loadu_ps(x + n), f)));
+        }
+#elif defined(SPX_BEAMFORMER_NEON)
+        for (; n + 4 <= count; n += 4)
+        {
+            vst1q_f32(sum + n, vmlaq_n_f32(vld1q_f32(sum + n), vld1q_f32(x + n), factor));
+        }
+#endif
+        for (; n < count; n++)
+        {
+            sum[n] += x[n] * factor;
+        }
+    }
+
+    size_t m_microphones;
+    size_t m_historyLength = filterTaps;
+    std::vector<size_t> m_wholeDelays;
+    std::vector<std::vector<float>> m_taps;
+    std::vector<std::vector<float>> m_channels;
+    std::vector<float> m_sum;
+};
+
+// Reads a multichannel wav file recorded with a microphone array and returns beamformed mono audio
+// (same sample rate, 16-bit), e.g. to feed a pull audio input stream of a regular speech recognizer.
+class BeamformingWavReader final
+{
+public:
+    BeamformingWavReader(const std::string& audioFileName, const MicrophoneArrayGeometry& geometry, double azimuthDegrees, double elevationDegrees = 0)
+        : m_reader(audioFileName)
+    {
+        const auto& format = m_reader.GetFormat();
+        if (format.Channels < geometry.Microphones.size())
+        {
+            throw std::invalid_argument("Expected audio with at least one channel per microphone.");
+        }
+        m_channels = format.Channels;
+        m_beamformer.reset(new DelayAndSumBeamformer(geometry, format.SamplesPerSec, azimuthDegrees, elevationDegrees));
+    }
+
+    // Same as WavFileReader::Read(), for the mono output. Returns 0 only at the end of the file: a request that ends
+    // within a sample (e.g. of a single byte) gets the first byte of it, and the next read starts with the rest.
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        // The rest of a sample split by the previous read.
+        uint32_t copied = 0;
+        if (m_splitBytes > 0 && size > 0)
+        {
+            *dataBuffer = m_split[sizeof(m_split) - m_splitBytes];
+            m_splitBytes--;
+            copied++;
+        }
+
+        // Whole samples go straight to the buffer; a partial one at the end is beamformed aside and split.
+        auto whole = (size - copied) / sizeof(int16_t);
+        auto frames = whole + ((size - copied) % sizeof(int16_t) != 0 ? 1 : 0);
+        if (frames == 0)
+        {
+            return (int)copied;
+        }
+        m_input.resize(frames * m_channels);
+        auto bytes = m_reader.Read((uint8_t*)m_input.data(), (uint32_t)(m_input.size() * sizeof(int16_t)));
+        frames = bytes / (m_channels * sizeof(int16_t));
+
+        // After a split sample the output is misaligned for int16_t and goes through m_output.
+        auto direct = std::min(frames, whole);
+        auto output = dataBuffer + copied;
+        if ((uintptr_t)output % alignof(int16_t) == 0)
+        {
+            m_beamformer->Process(m_input.data(), direct, m_channels, (int16_t*)output);
+        }
+        else
+        {
+            m_output.resize(direct);
+            m_beamformer->Process(m_input.data(), direct, m_channels, m_output.data());
+            memcpy(output, m_output.data(), direct * sizeof(int16_t));
+        }
+        copied += (uint32_t)(direct * sizeof(int16_t));
+        if (frames > whole)
+        {
+            int16_t sample;
+            m_beamformer->Process(m_input.data() + whole * m_channels, 1, m_channels, &sample);
+            memcpy(m_split, &sample, sizeof(m_split));
+            dataBuffer[copied++] = m_split[0];
+            m_splitBytes = sizeof(m_split) - 1;
+        }
+        return (int)copied;
+    }
+
+    void Close()
+    {
+        m_reader.Close();
+    }
+
+    // Format of the audio returned by Read().
+    uint32_t GetSampleRate() const
+    {
+        return m_reader.GetFormat().SamplesPerSec;
+    }
+
+private:
+    Int16WavFileReader m_reader;
+    size_t m_channels;
+    std::unique_ptr<DelayAndSumBeamformer> m_beamformer;
+    std::vector<int16_t> m_input;
+    std::vector<int16_t> m_output;
+    uint8_t m_split[sizeof(int16_t)];
+    uint32_t m_splitBytes = 0;      // Bytes of m_split not returned yet.
+};
@@ -8,6 +8,7 @@
 #include <speechapi_cxx.h>
 #include <fstream>
 #include "wav_file_reader.h"
+#include "speaker_timeline.h"
 #include <chrono>
 
 using namespace std;
@@ -75,6 +76,10 @@ void ConversationWithPullAudioStream()
     auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(16000, 16, 8), callback);
     auto audioInput = AudioConfig::FromStreamInput(pullStream);
 
+    // Speaker turns of the conversation; can be queried at any time while the conversation goes on. Declared before the
+    // recognizer, whose event handlers refer to it, so that it outlives them.
+    SpeakerTimeline timeline;
+
     // Create a conversation from a speech config and conversation Id.
     auto conversation = Conversation::CreateConversationAsync(config, "ConversationTranscriberSamples").get();
 
@@ -120,7 +125,7 @@ void ConversationWithPullAudioStream()
         cout << "TRANSCRIBING: Text=" << e.Result->Text << std::endl;
     });
 
-    recognizer->Transcribed.Connect([](const ConversationTranscriptionEventArgs& e)
+    recognizer->Transcribed.Connect([&timeline](const ConversationTranscriptionEventArgs& e)
     {
         if (e.Result->Reason == ResultReason::RecognizedSpeech)
         {
@@ -128,6 +133,12 @@ void ConversationWithPullAudioStream()
                 << "  Offset=" << e.Result->Offset() << std::endl
                 << "  Duration=" << e.Result->Duration() << std::endl
                 << "  UserId=" << e.Result->UserId << std::endl;
+
+            timeline.Add(e.Result->Offset(), e.Result->Duration(), e.Result->UserId);
+            if (timeline.HasOverlap(e.Result->Offset(), e.Result->Offset() + e.Result->Duration()))
+            {
+                cout << "  Overlaps with another speaker" << std::endl;
+            }
         }
         else if (e.Result->Reason == ResultReason::NoMatch)
         {
@@ -168,6 +179,14 @@ void ConversationWithPullAudioStream()
 
     // Stops transcribing. This is optional.
     recognizer->StopTranscribingAsync().wait();
+
+    // Talk time per speaker, in seconds (offsets and durations are in ticks of 100 ns).
+    cout << "Conversation length: " << timeline.GetDuration() / 1e7 << " s, " << timeline.GetTurnCount() << " turns" << std::endl;
+    for (const auto& talkTime : timeline.GetTalkTimes())
+    {
+        cout << "  " << talkTime.first << ": " << talkTime.second / 1e7 << " s" << std::endl;
+    }
+    cout << "  Overlapping speech: " << timeline.GetOverlapTime() / 1e7 << " s" << std::endl;
 }
 
 // Transcribing conversation using a push audio stream
@@ -0,0 +1,550 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPX_JSON_SSE2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// On-demand scanning of JSON text. Nothing is parsed up front: a value is located by skipping the values before it,
+// and decoded only when it is read. Skipping looks at 16 bytes at a time for the few characters that matter (quotes
+// and backslashes inside strings; quotes and brackets elsewhere), so most of a document is never looked at byte by
+// byte.
+namespace JsonScan
+{
+#if defined(SPX_JSON_SSE2)
+    // Bit mask of the bytes of 'block' equal to any of the given characters.
+    inline int Match(__m128i block, char a, char b)
+    {
+        return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(a)), _mm_cmpeq_epi8(block, _mm_set1_epi8(b))));
+    }
+
+    inline int CountTrailingZeros(int mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, (unsigned long)mask);
+        return (int)index;
+#else
+        return __builtin_ctz((unsigned)mask);
+#endif
+    }
+#endif
+
+    inline const char* SkipWhitespace(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    // Returns the first quote or backslash at or after 'p', or 'end'.
+    inline const char* FindQuoteOrBackslash(const char* p, const char* end)
+    {
+#if defined(SPX_JSON_SSE2)
+        for (; p + 16 <= end; p += 16)
+        {
+            auto mask = Match(_mm_loadu_si128((const __m128i*)p), '"', '\\');
+            if (mask != 0)
+            {
+                return p + CountTrailingZeros(mask);
+            }
+        }
+#endif
+        while (p < end && *p != '"' && *p != '\\')
+        {
+            p++;
+        }
+        return p;
+    }
+
+    // Returns the first quote or bracket at or after 'p' (or a character that may be taken for one), or 'end'.
+    inline const char* FindStructural(const char* p, const char* end)
+    {
+#if defined(SPX_JSON_SSE2)
+        for (; p + 16 <= end; p += 16)
+        {
+            auto block = _mm_loadu_si128((const __m128i*)p);
+            // '[', ']', '{' and '}' (0x5B, 0x5D, 0x7B, 0x7D) all become 0x59 when bits 1, 2 and 5 are cleared. So do 'Y',
+            // 'y', '_' and DEL, which cannot occur outside strings in valid JSON; SkipValue() ignores them anyway.
+            auto brackets = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, _mm_set1_epi8((char)0xD9)), _mm_set1_epi8(0x59)));
+            auto mask = brackets | Match(block, '"', '"');
+            if (mask != 0)
+            {
+                return p + CountTrailingZeros(mask);
+            }
+        }
+#endif
+        while (p < end && *p != '"' && *p != '[' && *p != ']' && *p != '{' && *p != '}')
+        {
+            p++;
+        }
+        return p;
+    }
+
+    // 'p' is at an opening quote; returns the position after the closing one (or 'end').
+    inline const char* SkipString(const char* p, const char* end)
+    {
+        p++;
+        while (true)
+        {
+            p = FindQuoteOrBackslash(p, end);
+            if (p >= end)
+            {
+                return end;
+            }
+            if (*p == '"')
+            {
+                return p + 1;
+            }
+            p += 2;
+        }
+    }
+
+    // 'p' is at the start of a value; returns the position after it (or 'end' if the document is malformed).
+    inline const char* SkipValue(const char* p, const char* end)
+    {
+        if (p >= end)
+        {
+            return end;
+        }
+        if (*p == '"')
+        {
+            return SkipString(p, end);
+        }
+        if (*p == '{' || *p == '[')
+        {
+            int depth = 0;
+            while (true)
+            {
+                p = FindStructural(p, end);
+                if (p >= end)
+                {
+                    return end;
+                }
+                if (*p == '"')
+                {
+                    p = SkipString(p, end);
+                    continue;
+                }
+                if (*p == '{' || *p == '[')
+                {
+                    depth++;
+                }
+                else if (*p == '}' || *p == ']')
+                {
+                    depth--;
+                }
+                p++;
+                if (depth == 0)
+                {
+                    return p;
+                }
+            }
+        }
+        // Number, true, false or null.
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+        {
+            p++;
+        }
+        return p;
+    }
+
+    inline void AppendUtf8(std::string& text, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            text += (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            text += (char)(0xC0 | (codePoint >> 6));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            text += (char)(0xE0 | (codePoint >> 12));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            text += (char)(0xF0 | (codePoint >> 18));
+            text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    inline uint32_t ReadHex4(const char* p, const char* end)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4 && p + i < end; i++)
+        {
+            auto c = p[i];
+            value = value * 16 + (uint32_t)(c >= 'a' ? c - 'a' + 10 : c >= 'A' ? c - 'A' + 10 : c - '0');
+        }
+        return value;
+    }
+
+    // Decodes the string starting at the opening quote 'p' into 'text' (which is cleared first, keeping its capacity).
+    inline void DecodeString(const char* p, const char* end, std::string& text)
+    {
+        text.clear();
+        p++;
+        while (p < end)
+        {
+            auto next = FindQuoteOrBackslash(p, end);
+            text.append(p, next);
+            if (next + 1 >= end || *next == '"')
+            {
+                return;
+            }
+            p = next + 2;
+            switch (next[1])
+            {
+            case 'b': text += '\b'; break;
+            case 'f': text += '\f'; break;
+            case 'n': text += '\n'; break;
+            case 'r': text += '\r'; break;
+            case 't': text += '\t'; break;
+            case 'u':
+            {
+                auto codePoint = ReadHex4(p, end);
+                p += 4;
+                // A surrogate pair encodes one code point above U+FFFF.
+                if (codePoint >= 0xD800 && codePoint < 0xDC00 && p + 6 <= end && p[0] == '\\' && p[1] == 'u')
+                {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (ReadHex4(p + 2, end) - 0xDC00);
+                    p += 6;
+                }
+                AppendUtf8(text, codePoint);
+                break;
+            }
+            default: text += next[1]; break;
+            }
+        }
+    }
+}
+
+// A position in a JSON document: the start of one value. Copying it is free; it stays valid as long as the text does.
+//
+// Lookups never throw. A missing member, an index out of range or malformed text gives a value for which Exists()
+// is false, and reading it returns the fallback.
+class JsonValue
+{
+public:
+    JsonValue() = default;
+
+    JsonValue(const char* begin, const char* end)
+        : m_begin(JsonScan::SkipWhitespace(begin, end)), m_end(end)
+    {
+        if (m_begin >= m_end)
+        {
+            m_begin = nullptr;
+        }
+    }
+
+    bool Exists() const { return m_begin != nullptr; }
+    bool IsObject() const { return Exists() && *m_begin == '{'; }
+    bool IsArray() const { return Exists() && *m_begin == '['; }
+    bool IsString() const { return Exists() && *m_begin == '"'; }
+    bool IsNumber() const { return Exists() && (*m_begin == '-' || (*m_begin >= '0' && *m_begin <= '9')); }
+
+    // Gets a member of an object. Keys are compared as written in the text, without decoding escapes.
+    JsonValue operator[](const char* key) const
+    {
+        JsonValue found;
+        ForEachMember([&found, key](const char* name, size_t length, JsonValue value)
+        {
+            if (strlen(key) == length && memcmp(key, name, length) == 0)
+            {
+                found = value;
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    // Gets an element of an array. Elements before it are skipped, so iterate with ForEachElement() instead of
+    // indexing in a loop.
+    JsonValue operator[](size_t index) const
+    {
+        JsonValue found;
+        size_t i = 0;
+        ForEachElement([&found, &i, index](JsonValue element)
+        {
+            if (i++ == index)
+            {
+                found = element;
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    // Calls 'visit(name, nameLength, value)' for the members of an object until it returns false.
+    template <class Visitor>
+    void ForEachMember(Visitor visit) const
+    {
+        if (!IsObject())
+        {
+            return;
+        }
+        auto p = JsonScan::SkipWhitespace(m_begin + 1, m_end);
+        while (p < m_end && *p == '"')
+        {
+            auto nameEnd = JsonScan::SkipString(p, m_end);
+            auto valueBegin = JsonScan::SkipWhitespace(nameEnd, m_end);
+            if (valueBegin >= m_end || *valueBegin != ':')
+            {
+                return;
+            }
+            valueBegin = JsonScan::SkipWhitespace(valueBegin + 1, m_end);
+            if (!visit(p + 1, (size_t)(nameEnd - p - 2), JsonValue(valueBegin, m_end)))
+            {
+                return;
+            }
+            p = JsonScan::SkipWhitespace(JsonScan::SkipValue(valueBegin, m_end), m_end);
+            p = p < m_end && *p == ',' ? JsonScan::SkipWhitespace(p + 1, m_end) : m_end;
+        }
+    }
+
+    // Calls 'visit(element)' for the elements of an array until it returns false.
+    template <class Visitor>
+    void ForEachElement(Visitor visit) const
+    {
+        if (!IsArray())
+        {
+            return;
+        }
+        auto p = JsonScan::SkipWhitespace(m_begin + 1, m_end);
+        while (p < m_end && *p != ']')
+        {
+            if (!visit(JsonValue(p, m_end)))
+            {
+                return;
+            }
+            p = JsonScan::SkipWhitespace(JsonScan::SkipValue(p, m_end), m_end);
+            p = p < m_end && *p == ',' ? JsonScan::SkipWhitespace(p + 1, m_end) : m_end;
+        }
+    }
+
+    size_t Size() const
+    {
+        size_t size = 0;
+        ForEachElement([&size](JsonValue) { size++; return true; });
+        return size;
+    }
+
+    // Decodes a string into 'text', reusing its buffer; returns false (and leaves 'text' empty) if this is not a string.
+    bool GetString(std::string& text) const
+    {
+        if (!IsString())
+        {
+            text.clear();
+            return false;
+        }
+        JsonScan::DecodeString(m_begin, m_end, text);
+        return true;
+    }
+
+    std::string AsString(const std::string& fallback = std::string()) const
+    {
+        std::string text;
+        return GetString(text) ? text : fallback;
+    }
+
+    double AsDouble(double fallback = 0) const
+    {
+        if (!IsNumber())
+        {
+            return fallback;
+        }
+        // Integers, the common case (offsets, durations), are read directly.
+        auto p = m_begin + (*m_begin == '-' ? 1 : 0);
+        uint64_t integer = 0;
+        int digits = 0;
+        for (; p < m_end && *p >= '0' && *p <= '9' && digits < 18; p++, digits++)
+        {
+            integer = integer * 10 + (uint64_t)(*p - '0');
+        }
+        if (p >= m_end || (*p != '.' && *p != 'e' && *p != 'E' && (*p < '0' || *p > '9')))
+        {
+            return *m_begin == '-' ? -(double)integer : (double)integer;
+        }
+        // The document is a std::string, so the text is null-terminated and strtod() stops at its end.
+        return strtod(m_begin, nullptr);
+    }
+
+    uint64_t AsUInt64(uint64_t fallback = 0) const
+    {
+        if (!IsNumber() || *m_begin == '-')
+        {
+            return fallback;
+        }
+        uint64_t value = 0;
+        for (auto p = m_begin; p < m_end && *p >= '0' && *p <= '9'; p++)
+        {
+            value = value * 10 + (uint64_t)(*p - '0');
+        }
+        return value;
+    }
+
+    bool AsBool(bool fallback = false) const
+    {
+        if (Exists() && (m_end - m_begin) >= 4 && memcmp(m_begin, "true", 4) == 0)
+        {
+            return true;
+        }
+        if (Exists() && (m_end - m_begin) >= 5 && memcmp(m_begin, "false", 5) == 0)
+        {
+            return false;
+        }
+        return fallback;
+    }
+
+private:
+    const char* m_begin = nullptr;
+    const char* m_end = nullptr;
+};
+
+// A word of a detailed result (requested with SpeechConfig::RequestWordLevelTimestamps() or pronunciation assessment).
+class DetailedWord
+{
+public:
+    explicit DetailedWord(JsonValue word) : m_word(word) {}
+
+    std::string Word() const { return m_word["Word"].AsString(); }
+    uint64_t Offset() const { return m_word["Offset"].AsUInt64(); }     // In ticks of 100 ns.
+    uint64_t Duration() const { return m_word["Duration"].AsUInt64(); } // In ticks of 100 ns.
+    double Confidence() const { return m_word["Confidence"].AsDouble(NAN); }
+
+    // Pronunciation assessment; NaN or empty if it was not requested.
+    double AccuracyScore() const { return Assessment()["AccuracyScore"].AsDouble(NAN); }
+    std::string ErrorType() const { return Assessment()["ErrorType"].AsString(); }
+
+    JsonValue Json() const { return m_word; }
+
+private:
+    // Scores are in a PronunciationAssessment object, or (in older service versions) in the word itself.
+    JsonValue Assessment() const
+    {
+        auto assessment = m_word["PronunciationAssessment"];
+        return assessment.Exists() ? assessment : m_word;
+    }
+
+    JsonValue m_word;
+};
+
+// One entry of the NBest list of a detailed result.
+class DetailedAlternative
+{
+public:
+    explicit DetailedAlternative(JsonValue alternative) : m_alternative(alternative) {}
+
+    double Confidence() const { return m_alternative["Confidence"].AsDouble(NAN); }
+    std::string Lexical() const { return m_alternative["Lexical"].AsString(); }
+    std::string ITN() const { return m_alternative["ITN"].AsString(); }
+    std::string MaskedITN() const { return m_alternative["MaskedITN"].AsString(); }
+    std::string Display() const { return m_alternative["Display"].AsString(); }
+
+    // Pronunciation assessment; NaN if it was not requested.
+    double AccuracyScore() const { return Assessment()["AccuracyScore"].AsDouble(NAN); }
+    double FluencyScore() const { return Assessment()["FluencyScore"].AsDouble(NAN); }
+    double CompletenessScore() const { return Assessment()["CompletenessScore"].AsDouble(NAN); }
+    double PronunciationScore() const { return Assessment()["PronScore"].AsDouble(NAN); }
+
+    size_t GetWordCount() const { return m_alternative["Words"].Size(); }
+
+    // Calls 'visit(word)' for every word, in order.
+    template <class Visitor>
+    void ForEachWord(Visitor visit) const
+    {
+        m_alternative["Words"].ForEachElement([&visit](JsonValue word) { visit(DetailedWord(word)); return true; });
+    }
+
+    JsonValue Json() const { return m_alternative; }
+
+private:
+    JsonValue Assessment() const
+    {
+        auto assessment = m_alternative["PronunciationAssessment"];
+        return assessment.Exists() ? assessment : m_alternative;
+    }
+
+    JsonValue m_alternative;
+};
+
+// Reads the detailed JSON of recognition results (PropertyId::SpeechServiceResponse_JsonResult) on demand: NBest
+// alternatives, confidences, word timings and pronunciation scores are located and decoded only when asked for.
+//
+// The parser keeps its own copy of the text and an index of the NBest entries, both reused from one result to the
+// next, so a parser per thread (e.g. 'thread_local DetailedResultParser parser;' in an event handler) does not allocate
+// once it has seen a result of typical size. What Parse() returns stays valid until the next Parse() on the parser.
+class DetailedResultParser final
+{
+public:
+    DetailedResultParser& Parse(const std::string& json)
+    {
+        m_json.assign(json);
+        m_alternatives.clear();
+        m_indexed = false;
+        return *this;
+    }
+
+    JsonValue Root() const
+    {
+        return JsonValue(m_json.data(), m_json.data() + m_json.size());
+    }
+
+    std::string RecognitionStatus() const { return Root()["RecognitionStatus"].AsString(); }
+    std::string DisplayText() const { return Root()["DisplayText"].AsString(); }
+    uint64_t Offset() const { return Root()["Offset"].AsUInt64(); }       // In ticks of 100 ns.
+    uint64_t Duration() const { return Root()["Duration"].AsUInt64(); }   // In ticks of 100 ns.
+
+    size_t GetAlternativeCount()
+    {
+        Index();
+        return m_alternatives.size();
+    }
+
+    // The alternatives are ordered by confidence, best first.
+    DetailedAlternative GetAlternative(size_t index)
+    {
+        Index();
+        return DetailedAlternative(index < m_alternatives.size() ? m_alternatives[index] : JsonValue());
+    }
+
+private:
+    // Finds the NBest entries once, so that they can be accessed by index.
+    void Index()
+    {
+        if (!m_indexed)
+        {
+            Root()["NBest"].ForEachElement([this](JsonValue alternative) { m_alternatives.push_back(alternative); return true; });
+            m_indexed = true;
+        }
+    }
+
+    std::string m_json;
+    std::vector<JsonValue> m_alternatives;
+    bool m_indexed = false;
+};
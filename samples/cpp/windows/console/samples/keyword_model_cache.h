@@ -0,0 +1,115 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Request statistics of one cached keyword model.
+struct KeywordModelCacheEntryStatistics
+{
+    std::string FileName;
+    uint64_t Requests = 0;
+};
+
+// Process-wide registry of keyword recognition models. KeywordRecognitionModel::FromFile() is called once per .table
+// file, on first request, and the same model object is handed to every recognizer that asks for it; concurrent first
+// requests wait for the single call. How much of the model data the SDK reads in FromFile(), and whether recognizers
+// sharing a model object share that data, is up to the SDK; the cache only guarantees one model object per file.
+class KeywordModelCache final
+{
+public:
+    static KeywordModelCache& Instance()
+    {
+        static KeywordModelCache instance;
+        return instance;
+    }
+
+    // Gets the model loaded from 'fileName', loading it if this is the first request. Throws if the load fails;
+    // a failed load is not cached, so the next request retries it.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> Get(const std::string& fileName)
+    {
+        std::shared_future<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel>> model;
+        std::promise<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel>> load;
+        uint64_t loadId = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& entry = m_entries[fileName];
+            entry.Statistics.Requests++;
+            if (!entry.Model.valid())
+            {
+                entry.Statistics.FileName = fileName;
+                entry.Model = load.get_future().share();
+                entry.LoadId = loadId = ++m_lastLoadId;
+            }
+            model = entry.Model;
+        }
+
+        if (loadId != 0)
+        {
+            Load(fileName, loadId, load);
+        }
+        return model.get();
+    }
+
+    // Gets the statistics of all models requested so far.
+    std::vector<KeywordModelCacheEntryStatistics> GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<KeywordModelCacheEntryStatistics> statistics;
+        for (const auto& entry : m_entries)
+        {
+            statistics.push_back(entry.second.Statistics);
+        }
+        return statistics;
+    }
+
+    // Releases the cache's references to all models; recognizers still using a model keep it alive.
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+
+private:
+    struct Entry
+    {
+        std::shared_future<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel>> Model;
+        KeywordModelCacheEntryStatistics Statistics;
+        uint64_t LoadId = 0;        // Identifies the load that created Model.
+    };
+
+    KeywordModelCache() = default;
+
+    // Loads the model of the entry created with 'loadId'. If the load fails, that entry is removed (unless Clear() and a
+    // new request have replaced it meanwhile), so that the next request retries.
+    void Load(const std::string& fileName, uint64_t loadId, std::promise<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel>>& load)
+    {
+        try
+        {
+            load.set_value(Microsoft::CognitiveServices::Speech::KeywordRecognitionModel::FromFile(fileName));
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto entry = m_entries.find(fileName);
+                if (entry != m_entries.end() && entry->second.LoadId == loadId)
+                {
+                    m_entries.erase(entry);
+                }
+            }
+            load.set_exception(std::current_exception());
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    uint64_t m_lastLoadId = 0;
+};
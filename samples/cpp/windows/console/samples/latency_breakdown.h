@@ -0,0 +1,199 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "detailed_result_json.h"
+
+// Where the time between the end of an utterance's audio and its result went. All values in milliseconds.
+//
+// The service does not report its own timings, so the split is estimated from local timestamps. Hypotheses are sent
+// as soon as the service has decoded the audio they cover, so the lag of a hypothesis (its arrival minus the moment
+// the end of its audio was handed to the SDK) is network round trip plus decoding plus any backlog. The lowest lag of
+// the session is taken as the round trip with no backlog:
+// - DeliveryDelayMs: that lowest lag, i.e. the network round trip (uplink of the last audio and downlink of the result).
+// - UploadLagMs: how far the last hypothesis of the utterance lagged beyond that, i.e. audio queued on the way to the
+//   recognizer (in the SDK, the uplink or the service's input).
+// - ServiceProcessingMs: the rest of the time until the phrase arrived, i.e. end-of-speech detection and the final
+//   decoding pass.
+struct UtteranceLatency
+{
+    uint64_t Offset = 0;            // Of the phrase, in ticks of 100 ns from the start of the audio.
+    uint64_t Duration = 0;          // In ticks of 100 ns.
+    size_t Hypotheses = 0;
+    double TotalMs = 0;             // From the last audio of the utterance being handed to the SDK to the arrival of the phrase.
+    double UploadLagMs = 0;
+    double ServiceProcessingMs = 0;
+    double DeliveryDelayMs = 0;
+};
+
+// Correlates the messages of a recognizer's service connection (turn.start, speech.hypothesis, speech.phrase,
+// turn.end) with the times the application handed audio to the SDK, and breaks the latency of every utterance down
+// into upload lag, service processing and delivery delay.
+//
+// Call OnAudioSent() from the audio input (a pull stream callback's Read() or after writing to a push stream). The
+// service offsets are counted from the start of the audio of its connection, so the breakdown assumes a session on
+// a single connection.
+class ConnectionLatencyTracker final
+{
+public:
+    // 'bytesPerSecond' is the byte rate of the input audio (AvgBytesPerSec of its format).
+    explicit ConnectionLatencyTracker(uint32_t bytesPerSecond)
+        : m_bytesPerSecond(bytesPerSecond)
+    {
+    }
+
+    // Subscribes to the messages of the recognizer's connection. The tracker must outlive the recognizer.
+    template <class Recognizer>
+    void Attach(std::shared_ptr<Recognizer> recognizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        m_connection = Connection::FromRecognizer(recognizer);
+        m_connection->MessageReceived.Connect([this](const ConnectionMessageEventArgs& e)
+        {
+            auto arrival = std::chrono::steady_clock::now();
+            auto message = e.GetMessage();
+            if (message->IsTextMessage())
+            {
+                OnMessage(message->GetPath(), message->GetTextMessage(), arrival);
+            }
+        });
+    }
+
+    // Records that 'bytes' more audio were handed to the SDK now.
+    void OnAudioSent(size_t bytes)
+    {
+        if (bytes == 0)
+        {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytesSent += bytes;
+        m_sent.push_back(SentAudio{ m_bytesSent * 10000000 / m_bytesPerSecond, now });
+    }
+
+    // Gets the breakdown of every utterance recognized so far, in order.
+    std::vector<UtteranceLatency> GetUtterances() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<UtteranceLatency> utterances;
+        for (const auto& phrase : m_phrases)
+        {
+            UtteranceLatency utterance;
+            utterance.Offset = phrase.Offset;
+            utterance.Duration = phrase.Duration;
+            utterance.Hypotheses = phrase.Hypotheses;
+            utterance.TotalMs = phrase.TotalMs;
+            auto floor = std::isfinite(m_lowestLagMs) ? m_lowestLagMs : 0;
+            auto lag = phrase.Hypotheses > 0 ? phrase.LastHypothesisLagMs : floor;
+            utterance.DeliveryDelayMs = std::min(floor, phrase.TotalMs);
+            utterance.UploadLagMs = std::max(0.0, std::min(lag, phrase.TotalMs) - utterance.DeliveryDelayMs);
+            utterance.ServiceProcessingMs = phrase.TotalMs - utterance.DeliveryDelayMs - utterance.UploadLagMs;
+            utterances.push_back(utterance);
+        }
+        return utterances;
+    }
+
+    // From the first audio handed to the SDK to the arrival of turn.start; negative if either has not happened.
+    double GetTurnStartDelayMs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sent.empty() || !m_turnStarted ? -1 : Milliseconds(m_turnStart - m_sent.front().Time);
+    }
+
+    // From the last audio handed to the SDK to the arrival of turn.end; negative if it has not arrived.
+    double GetTurnEndDelayMs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sent.empty() || !m_turnEnded ? -1 : Milliseconds(m_turnEnd - m_sent.back().Time);
+    }
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    // Audio handed to the SDK: the end of it (in ticks from the start of the audio) and when.
+    struct SentAudio
+    {
+        uint64_t EndTicks;
+        TimePoint Time;
+    };
+
+    struct Phrase
+    {
+        uint64_t Offset;
+        uint64_t Duration;
+        size_t Hypotheses;
+        double LastHypothesisLagMs;
+        double TotalMs;
+    };
+
+    static double Milliseconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    // When the audio up to 'ticks' had been handed to the SDK.
+    TimePoint SentTime(uint64_t ticks) const
+    {
+        auto sent = std::lower_bound(m_sent.begin(), m_sent.end(), ticks, [](const SentAudio& audio, uint64_t end) { return audio.EndTicks < end; });
+        return sent == m_sent.end() ? m_sent.back().Time : sent->Time;
+    }
+
+    void OnMessage(const std::string& path, const std::string& text, TimePoint arrival)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (path == "turn.start")
+        {
+            m_turnStart = arrival;
+            m_turnStarted = true;
+        }
+        else if (path == "turn.end")
+        {
+            m_turnEnd = arrival;
+            m_turnEnded = true;
+        }
+        else if ((path == "speech.hypothesis" || path == "speech.phrase") && !m_sent.empty())
+        {
+            JsonValue json(text.data(), text.data() + text.size());
+            auto offset = json["Offset"].AsUInt64();
+            auto duration = json["Duration"].AsUInt64();
+            auto lagMs = Milliseconds(arrival - SentTime(offset + duration));
+            if (path == "speech.hypothesis")
+            {
+                m_lowestLagMs = std::min(m_lowestLagMs, lagMs);
+                m_hypotheses++;
+                m_lastHypothesisLagMs = lagMs;
+            }
+            else
+            {
+                m_phrases.push_back(Phrase{ offset, duration, m_hypotheses, m_lastHypothesisLagMs, lagMs });
+                m_hypotheses = 0;
+            }
+        }
+    }
+
+    uint32_t m_bytesPerSecond;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection> m_connection;
+    mutable std::mutex m_mutex;
+    uint64_t m_bytesSent = 0;
+    std::vector<SentAudio> m_sent;
+    std::vector<Phrase> m_phrases;
+    size_t m_hypotheses = 0;                // Of the current utterance.
+    double m_lastHypothesisLagMs = 0;
+    double m_lowestLagMs = INFINITY;
+    TimePoint m_turnStart;
+    TimePoint m_turnEnd;
+    bool m_turnStarted = false;
+    bool m_turnEnded = false;
+};
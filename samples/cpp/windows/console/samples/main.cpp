@@ -16,6 +16,12 @@ extern void SpeechContinuousRecognitionWithPullStream();
 extern void SpeechContinuousRecognitionWithPushStream();
 extern void KeywordTriggeredSpeechRecognitionWithMicrophone();
 extern void PronunciationAssessmentWithMicrophone();
+extern void SpeechContinuousRecognitionWithPullStreamAndTracing();
+extern void SpeechContinuousRecognitionWithTranscriptIndex();
+extern void SpeechContinuousRecognitionWithBeamforming();
+extern void SpeechRecognitionWithParallelWindows();
+extern void SpeechContinuousRecognitionWithLatencyBreakdown();
+extern void SpeechContinuousRecognitionWithSdkLogAnalysis();
 
 extern void IntentRecognitionWithMicrophone();
 extern void IntentRecognitionWithLanguage();
@@ -37,6 +43,8 @@ extern void SpeechSynthesisEvents();
 extern void SpeechSynthesisWordBoundaryEvent();
 extern void SpeechSynthesisWithSourceLanguageAutoDetection();
 extern void SpeechSynthesisUsingCustomVoice();
+extern void SpeechSynthesisToFilesInBatch();
+extern void SpeechSynthesisToManyOutputStreamsWithOnePoller();
 
 extern void ConversationWithPullAudioStream();
 extern void ConversationWithPushAudioStream();
@@ -60,6 +68,12 @@ void SpeechSamples()
         cout << "6.) Speech recognition using push stream input.\n";
         cout << "7.) Speech recognition using microphone with a keyword trigger.\n";
         cout << "8.) Pronunciation assessment using microphone input.\n";
+        cout << "9.) Speech recognition using pull stream input, with trace export.\n";
+        cout << "A.) Speech continuous recognition with file input, with phrase search in the transcript.\n";
+        cout << "B.) Speech recognition of a microphone array recording, beamformed on the client.\n";
+        cout << "C.) Speech recognition of a long file as overlapping windows in parallel.\n";
+        cout << "D.) Speech recognition of a file streamed in real time, with a latency breakdown per utterance.\n";
+        cout << "E.) Speech continuous recognition of several files, with a summary of the SDK log of every session.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -92,6 +106,29 @@ void SpeechSamples()
         case '8':
             PronunciationAssessmentWithMicrophone();
             break;
+        case '9':
+            SpeechContinuousRecognitionWithPullStreamAndTracing();
+            break;
+        case 'A':
+        case 'a':
+            SpeechContinuousRecognitionWithTranscriptIndex();
+            break;
+        case 'B':
+        case 'b':
+            SpeechContinuousRecognitionWithBeamforming();
+            break;
+        case 'C':
+        case 'c':
+            SpeechRecognitionWithParallelWindows();
+            break;
+        case 'D':
+        case 'd':
+            SpeechContinuousRecognitionWithLatencyBreakdown();
+            break;
+        case 'E':
+        case 'e':
+            SpeechContinuousRecognitionWithSdkLogAnalysis();
+            break;
         case '0':
             break;
         }
@@ -177,6 +214,8 @@ void SpeechSynthesisSamples()
         cout << "B.) Speech synthesis word boundary event.\n";
         cout << "C.) Speech synthesis with source language auto detection\n";
         cout << "D.) Speech synthesis using Custom Voice\n";
+        cout << "E.) Speech synthesis of many texts to wave files, written in batches\n";
+        cout << "F.) Speech synthesis of several texts at once, with all output streams read by one thread\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -227,6 +266,15 @@ void SpeechSynthesisSamples()
         case 'D':
         case 'd':
             SpeechSynthesisUsingCustomVoice();
+            break;
+        case 'E':
+        case 'e':
+            SpeechSynthesisToFilesInBatch();
+            break;
+        case 'F':
+        case 'f':
+            SpeechSynthesisToManyOutputStreamsWithOnePoller();
+            break;
         case '0':
             break;
         }
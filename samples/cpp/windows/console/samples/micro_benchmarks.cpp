@@ -0,0 +1,171 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Google Benchmark micro-benchmarks for the client-side audio primitives used by the console samples.
+// The inputs are generated deterministically from sampledata/audiofiles before the benchmarks run, so results
+// are comparable from release to release. Use --benchmark_format=json or --benchmark_out=<file> for machine-readable output.
+//
+// Usage: micro_benchmarks [--input_dir <path to sampledata/audiofiles>] [Google Benchmark flags]
+//
+
+#include "stdafx.h"
+
+#include <benchmark/benchmark.h>
+#include <speechapi_cxx.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "wav_file_reader.h"
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+// Defined in speaker_recognition_samples.cpp.
+extern int PushData(const string& filename, shared_ptr<PushAudioInputStream>& pushStream);
+
+namespace
+{
+    // The generated input: 60 seconds of 16 kHz, 16-bit mono speech.
+    const char* benchmarkInputFileName = "micro_benchmark_input.wav";
+    constexpr uint32_t benchmarkInputSeconds = 60;
+
+    // Writes a canonical 44-byte header wav file.
+    void WriteWavFile(const string& fileName, const WavFileReader::WAVEFORMAT& format, const vector<uint8_t>& data)
+    {
+        ofstream out(fileName, ios_base::binary | ios_base::out | ios_base::trunc);
+        if (!out.good())
+        {
+            throw runtime_error("Failed to create the benchmark input file.");
+        }
+
+        auto writeUInt32 = [&out](uint32_t value) { out.write((const char*)&value, sizeof(value)); };
+        out.write("RIFF", 4);
+        writeUInt32((uint32_t)(36 + data.size()));
+        out.write("WAVEfmt ", 8);
+        writeUInt32((uint32_t)sizeof(format));
+        out.write((const char*)&format, sizeof(format));
+        out.write("data", 4);
+        writeUInt32((uint32_t)data.size());
+        out.write((const char*)data.data(), data.size());
+    }
+
+    // Repeats the audio of 'sourceFileName' until it fills exactly benchmarkInputSeconds, and writes it to the benchmark input file.
+    void GenerateInput(const string& sourceFileName)
+    {
+        WavFileReader reader(sourceFileName);
+        auto format = reader.GetFormat();
+
+        vector<uint8_t> source;
+        vector<uint8_t> buffer(4096);
+        int read = 0;
+        while ((read = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
+        {
+            source.insert(source.end(), buffer.data(), buffer.data() + read);
+        }
+        if (source.empty())
+        {
+            throw runtime_error("The benchmark source file has no audio data.");
+        }
+
+        vector<uint8_t> data(format.AvgBytesPerSec * benchmarkInputSeconds);
+        for (size_t offset = 0; offset < data.size(); offset += source.size())
+        {
+            memcpy(data.data() + offset, source.data(), min(source.size(), data.size() - offset));
+        }
+
+        WriteWavFile(benchmarkInputFileName, format, data);
+    }
+
+    // Reads the whole data chunk at the chunk size given as the benchmark argument.
+    void BM_WavFileReaderRead(benchmark::State& state)
+    {
+        vector<uint8_t> buffer((size_t)state.range(0));
+        int64_t bytes = 0;
+        for (auto _ : state)
+        {
+            WavFileReader reader(benchmarkInputFileName);
+            int read = 0;
+            while ((read = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
+            {
+                bytes += read;
+            }
+            benchmark::DoNotOptimize(buffer.data());
+        }
+        state.SetBytesProcessed(bytes);
+    }
+    BENCHMARK(BM_WavFileReaderRead)->Arg(320)->Arg(1000)->Arg(3200)->Arg(32000)->Arg(320000);
+
+    // Opens the file and parses the RIFF header (GetFormatFromWavFile), as done for every new session.
+    void BM_WavFileReaderOpen(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            WavFileReader reader(benchmarkInputFileName);
+            benchmark::DoNotOptimize(reader.GetFormat().SamplesPerSec);
+        }
+    }
+    BENCHMARK(BM_WavFileReaderOpen);
+
+    // Pushes the whole file into an SDK push stream with the PushData helper of the speaker recognition samples.
+    void BM_PushData(benchmark::State& state)
+    {
+        const int64_t fileBytes = (int64_t)WavFileReader(benchmarkInputFileName).GetFormat().AvgBytesPerSec * benchmarkInputSeconds;
+        for (auto _ : state)
+        {
+            auto pushStream = AudioInputStream::CreatePushStream();
+            PushData(benchmarkInputFileName, pushStream);
+        }
+        state.SetBytesProcessed((int64_t)state.iterations() * fileBytes);
+    }
+    BENCHMARK(BM_PushData)->Unit(benchmark::kMillisecond);
+
+    // Appends chunks of the size given as the benchmark argument to a growing byte vector, the way
+    // PushAudioOutputStreamSampleCallback::Write in the synthesis samples does.
+    void BM_OutputSinkAppend(benchmark::State& state)
+    {
+        const size_t totalSize = 16000 * 2 * benchmarkInputSeconds;
+        vector<uint8_t> chunk((size_t)state.range(0), 0x5a);
+        for (auto _ : state)
+        {
+            auto audioData = make_shared<vector<uint8_t>>();
+            for (size_t written = 0; written < totalSize; written += chunk.size())
+            {
+                auto oldSize = audioData->size();
+                audioData->resize(oldSize + chunk.size());
+                memcpy(audioData->data() + oldSize, chunk.data(), chunk.size());
+            }
+            benchmark::DoNotOptimize(audioData->data());
+        }
+        state.SetBytesProcessed((int64_t)state.iterations() * totalSize);
+    }
+    BENCHMARK(BM_OutputSinkAppend)->Arg(3200)->Arg(32000);
+}
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+
+    string inputDirectory = "../../../../../sampledata/audiofiles";
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--input_dir" && i + 1 < argc)
+        {
+            inputDirectory = argv[++i];
+        }
+    }
+
+    try
+    {
+        GenerateInput(inputDirectory + "/aboutSpeechSdk.wav");
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << endl;
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    remove(benchmarkInputFileName);
+    return 0;
+}
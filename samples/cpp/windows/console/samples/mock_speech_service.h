@@ -0,0 +1,604 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#if !defined(__linux__)
+#error "The mock speech service is only available on Linux."
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <strings.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A local stand-in for the speech service, for benchmarks that must not depend on the network or on service capacity.
+// It accepts plain WebSocket connections (point the SDK to it with SpeechConfig::FromHost("ws://127.0.0.1:<port>")),
+// consumes the audio messages of a recognition turn, and answers with a fixed phrase for every 'phraseSeconds' of
+// 16 kHz 16-bit mono audio it has received, followed by speech.endDetected and turn.end when the audio ends.
+// It implements only as much of the WebSocket and service protocols as the recognizer needs.
+class MockSpeechService final
+{
+public:
+    MockSpeechService(uint16_t port, double phraseSeconds = 3.0, int processingDelayMs = 0)
+        : m_phraseBytes((uint64_t)(phraseSeconds * bytesPerSecond)), m_processingDelayMs(processingDelayMs)
+    {
+        m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listenSocket < 0)
+        {
+            throw std::runtime_error("Failed to create the mock service socket.");
+        }
+
+        int reuse = 1;
+        setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(m_listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(m_listenSocket, SOMAXCONN) != 0)
+        {
+            close(m_listenSocket);
+            throw std::runtime_error("Failed to listen on the mock service port.");
+        }
+
+        socklen_t length = sizeof(address);
+        getsockname(m_listenSocket, (sockaddr*)&address, &length);
+        m_port = ntohs(address.sin_port);
+    }
+
+    ~MockSpeechService()
+    {
+        Stop();
+    }
+
+    MockSpeechService(const MockSpeechService&) = delete;
+    MockSpeechService& operator=(const MockSpeechService&) = delete;
+
+    // Gets the port the service listens on (useful when constructed with port 0).
+    uint16_t GetPort() const
+    {
+        return m_port;
+    }
+
+    // Gets the host URL to pass to SpeechConfig::FromHost().
+    std::string GetHost() const
+    {
+        return "ws://127.0.0.1:" + std::to_string(m_port);
+    }
+
+    // Runs a service in a forked child process, so that its threads and memory are not counted against the caller.
+    // Sets 'host' to the URL to pass to SpeechConfig::FromHost() and returns the pid of the child; terminate it with kill().
+    static pid_t StartInChildProcess(std::string* host, double phraseSeconds = 3.0)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            throw std::runtime_error("Failed to create a pipe for the mock service.");
+        }
+
+        auto pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            MockSpeechService service(0, phraseSeconds);
+            auto port = service.GetPort();
+            if (write(fds[1], &port, sizeof(port)) != sizeof(port))
+            {
+                _exit(1);
+            }
+            close(fds[1]);
+            service.Run();
+            _exit(0);
+        }
+
+        close(fds[1]);
+        uint16_t port = 0;
+        auto received = read(fds[0], &port, sizeof(port));
+        close(fds[0]);
+        if (pid < 0 || received != sizeof(port))
+        {
+            throw std::runtime_error("Failed to start the mock service.");
+        }
+
+        *host = "ws://127.0.0.1:" + std::to_string(port);
+        return pid;
+    }
+
+    // Serves connections on a background thread until Stop() is called.
+    void Start()
+    {
+        m_acceptThread = std::thread([this]() { AcceptLoop(); });
+    }
+
+    // Serves connections on the calling thread; never returns unless the listening socket fails.
+    void Run()
+    {
+        AcceptLoop();
+    }
+
+    void Stop()
+    {
+        // Wakes the accept loop up; the socket is closed only once the loop has returned.
+        if (m_listenSocket >= 0 && !m_stopped.exchange(true))
+        {
+            shutdown(m_listenSocket, SHUT_RDWR);
+        }
+        if (m_acceptThread.joinable())
+        {
+            m_acceptThread.join();
+        }
+        if (m_listenSocket >= 0)
+        {
+            close(m_listenSocket);
+            m_listenSocket = -1;
+        }
+
+        // Ends the connections still open, so their threads return, and waits for them.
+        std::list<ConnectionThread> connections;
+        {
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            for (auto& connection : m_connections)
+            {
+                if (!connection.Finished)
+                {
+                    shutdown(connection.Socket, SHUT_RDWR);
+                }
+            }
+            connections.swap(m_connections);
+        }
+        for (auto& connection : connections)
+        {
+            connection.Thread.join();
+        }
+    }
+
+private:
+    static constexpr uint64_t bytesPerSecond = 16000 * 2;
+    static constexpr uint64_t ticksPerSecond = 10000000;
+    static constexpr uint64_t maxMessageBytes = 16 * 1024 * 1024;
+
+    // A connection and the thread serving it. The thread closes the socket and sets 'Finished' (both under
+    // m_connectionsMutex) when it is done, so that Stop() never shuts down a socket number that has been reused.
+    struct ConnectionThread
+    {
+        int Socket;
+        bool Finished;
+        std::thread Thread;
+    };
+
+    void AcceptLoop()
+    {
+        while (!m_stopped)
+        {
+            int connection = accept(m_listenSocket, nullptr, nullptr);
+            if (connection < 0)
+            {
+                if (m_stopped)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            int noDelay = 1;
+            setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            JoinFinishedConnections();
+            if (m_stopped)
+            {
+                close(connection);
+                break;
+            }
+            m_connections.push_back(ConnectionThread{ connection, false, std::thread() });
+            auto entry = std::prev(m_connections.end());
+            entry->Thread = std::thread([this, entry]()
+            {
+                ServeConnection(entry->Socket);
+                std::lock_guard<std::mutex> lock(m_connectionsMutex);
+                close(entry->Socket);
+                entry->Finished = true;
+            });
+        }
+    }
+
+    // Called with m_connectionsMutex held; the threads joined have already left ServeConnection().
+    void JoinFinishedConnections()
+    {
+        for (auto it = m_connections.begin(); it != m_connections.end();)
+        {
+            if (it->Finished)
+            {
+                it->Thread.join();
+                it = m_connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void ServeConnection(int connection)
+    {
+        if (Handshake(connection))
+        {
+            std::string requestId;
+            uint64_t audioBytes = 0;
+            uint64_t reportedBytes = 0;
+            bool turnStarted = false;
+            int phraseCount = 0;
+
+            uint8_t opcode = 0;
+            std::vector<uint8_t> payload;
+            while (ReadFrame(connection, &opcode, &payload))
+            {
+                if (opcode == 0x8)
+                {
+                    SendFrame(connection, 0x8, nullptr, 0);
+                    break;
+                }
+                if (opcode == 0x9)
+                {
+                    SendFrame(connection, 0xA, payload.data(), payload.size());
+                    continue;
+                }
+                if (opcode != 0x2 || payload.size() < 2)
+                {
+                    // Text messages (speech.config, speech.context) need no answer.
+                    continue;
+                }
+
+                // Binary messages: 2-byte big-endian header length, headers, audio.
+                size_t headerSize = ((size_t)payload[0] << 8) | payload[1];
+                if (2 + headerSize > payload.size())
+                {
+                    continue;
+                }
+                std::string headers((const char*)payload.data() + 2, headerSize);
+                size_t audioSize = payload.size() - 2 - headerSize;
+
+                auto id = GetHeader(headers, "X-RequestId");
+                if (id != requestId)
+                {
+                    requestId = id;
+                    audioBytes = reportedBytes = 0;
+                    turnStarted = false;
+                }
+
+                if (!turnStarted)
+                {
+                    turnStarted = true;
+                    SendServiceMessage(connection, requestId, "turn.start", "{\"context\":{\"serviceTag\":\"mock\"}}");
+                    SendServiceMessage(connection, requestId, "speech.startDetected", "{\"Offset\":0}");
+                }
+
+                audioBytes += audioSize;
+                while (audioBytes - reportedBytes >= m_phraseBytes)
+                {
+                    if (m_processingDelayMs > 0)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(m_processingDelayMs));
+                    }
+                    SendPhrase(connection, requestId, reportedBytes, m_phraseBytes, ++phraseCount);
+                    reportedBytes += m_phraseBytes;
+                }
+
+                // An audio message without audio data ends the turn.
+                if (audioSize == 0)
+                {
+                    if (audioBytes > reportedBytes)
+                    {
+                        SendPhrase(connection, requestId, reportedBytes, audioBytes - reportedBytes, ++phraseCount);
+                    }
+                    SendServiceMessage(connection, requestId, "speech.endDetected", "{\"Offset\":" + std::to_string(ToTicks(audioBytes)) + "}");
+                    SendServiceMessage(connection, requestId, "turn.end", "{}");
+                    turnStarted = false;
+                }
+            }
+        }
+    }
+
+    void SendPhrase(int connection, const std::string& requestId, uint64_t startBytes, uint64_t lengthBytes, int phraseNumber)
+    {
+        auto text = "Mock phrase number " + std::to_string(phraseNumber) + ".";
+        auto offset = std::to_string(ToTicks(startBytes));
+        auto duration = std::to_string(ToTicks(lengthBytes));
+        SendServiceMessage(connection, requestId, "speech.hypothesis",
+            "{\"Text\":\"" + text + "\",\"Offset\":" + offset + ",\"Duration\":" + duration + "}");
+        SendServiceMessage(connection, requestId, "speech.phrase",
+            "{\"RecognitionStatus\":\"Success\",\"DisplayText\":\"" + text + "\",\"Offset\":" + offset + ",\"Duration\":" + duration +
+            ",\"NBest\":[{\"Confidence\":0.9,\"Lexical\":\"" + text + "\",\"ITN\":\"" + text + "\",\"MaskedITN\":\"" + text + "\",\"Display\":\"" + text + "\"}]}");
+    }
+
+    void SendServiceMessage(int connection, const std::string& requestId, const char* path, const std::string& body)
+    {
+        auto message = "X-RequestId:" + requestId + "\r\nContent-Type:application/json; charset=utf-8\r\nPath:" + path + "\r\n\r\n" + body;
+        SendFrame(connection, 0x1, (const uint8_t*)message.data(), message.size());
+    }
+
+    static uint64_t ToTicks(uint64_t bytes)
+    {
+        return bytes * ticksPerSecond / bytesPerSecond;
+    }
+
+    static std::string GetHeader(const std::string& headers, const std::string& name)
+    {
+        size_t position = 0;
+        while (position < headers.size())
+        {
+            auto end = headers.find("\r\n", position);
+            if (end == std::string::npos)
+            {
+                end = headers.size();
+            }
+            auto colon = headers.find(':', position);
+            if (colon != std::string::npos && colon < end && strncasecmp(headers.c_str() + position, name.c_str(), name.size()) == 0 &&
+                colon - position == name.size())
+            {
+                auto valueStart = headers.find_first_not_of(' ', colon + 1);
+                return valueStart < end ? headers.substr(valueStart, end - valueStart) : std::string();
+            }
+            position = end + 2;
+        }
+        return std::string();
+    }
+
+    // Reads the HTTP upgrade request and answers with the WebSocket accept response.
+    static bool Handshake(int connection)
+    {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos)
+        {
+            auto received = recv(connection, buffer, sizeof(buffer), 0);
+            if (received <= 0 || request.size() > 64 * 1024)
+            {
+                return false;
+            }
+            request.append(buffer, received);
+        }
+
+        auto key = GetHeader(request.substr(request.find("\r\n") + 2), "Sec-WebSocket-Key");
+        if (key.empty())
+        {
+            return false;
+        }
+
+        auto response = std::string("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n") +
+            "Sec-WebSocket-Accept: " + Base64(Sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")) + "\r\n\r\n";
+        return SendAll(connection, (const uint8_t*)response.data(), response.size());
+    }
+
+    static bool ReadFrame(int connection, uint8_t* opcode, std::vector<uint8_t>* payload)
+    {
+        payload->clear();
+        bool final = false;
+        while (!final)
+        {
+            uint8_t header[2];
+            if (!ReceiveAll(connection, header, 2))
+            {
+                return false;
+            }
+            final = (header[0] & 0x80) != 0;
+            if ((header[0] & 0x0F) != 0)
+            {
+                *opcode = header[0] & 0x0F;
+            }
+
+            uint64_t length = header[1] & 0x7F;
+            if (length >= 126)
+            {
+                uint8_t extended[8];
+                size_t extendedSize = (length == 126) ? 2 : 8;
+                if (!ReceiveAll(connection, extended, extendedSize))
+                {
+                    return false;
+                }
+                length = 0;
+                for (size_t i = 0; i < extendedSize; i++)
+                {
+                    length = (length << 8) | extended[i];
+                }
+            }
+
+            uint8_t mask[4] = {};
+            bool masked = (header[1] & 0x80) != 0;
+            if (masked && !ReceiveAll(connection, mask, 4))
+            {
+                return false;
+            }
+
+            // The SDK sends small messages; a larger one is a broken or hostile client.
+            auto offset = payload->size();
+            if (length > maxMessageBytes - offset)
+            {
+                return false;
+            }
+            payload->resize(offset + length);
+            if (length > 0 && !ReceiveAll(connection, payload->data() + offset, length))
+            {
+                return false;
+            }
+            if (masked)
+            {
+                for (uint64_t i = 0; i < length; i++)
+                {
+                    (*payload)[offset + i] ^= mask[i % 4];
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool SendFrame(int connection, uint8_t opcode, const uint8_t* data, size_t size)
+    {
+        std::vector<uint8_t> frame;
+        frame.reserve(size + 10);
+        frame.push_back(0x80 | opcode);
+        if (size < 126)
+        {
+            frame.push_back((uint8_t)size);
+        }
+        else if (size <= 0xFFFF)
+        {
+            frame.push_back(126);
+            frame.push_back((uint8_t)(size >> 8));
+            frame.push_back((uint8_t)size);
+        }
+        else
+        {
+            frame.push_back(127);
+            for (int shift = 56; shift >= 0; shift -= 8)
+            {
+                frame.push_back((uint8_t)((uint64_t)size >> shift));
+            }
+        }
+        frame.insert(frame.end(), data, data + size);
+        return SendAll(connection, frame.data(), frame.size());
+    }
+
+    static bool ReceiveAll(int connection, uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            auto received = recv(connection, data, size, 0);
+            if (received <= 0)
+            {
+                return false;
+            }
+            data += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    static bool SendAll(int connection, const uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            auto sent = send(connection, data, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    static std::string Sha1(const std::string& input)
+    {
+        uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+        std::string message = input;
+        uint64_t bitLength = (uint64_t)input.size() * 8;
+        message += (char)0x80;
+        while (message.size() % 64 != 56)
+        {
+            message += (char)0;
+        }
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            message += (char)(bitLength >> shift);
+        }
+
+        auto rotate = [](uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); };
+        for (size_t block = 0; block < message.size(); block += 64)
+        {
+            uint32_t w[80];
+            for (int i = 0; i < 16; i++)
+            {
+                const auto* p = (const uint8_t*)message.data() + block + i * 4;
+                w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            }
+            for (int i = 16; i < 80; i++)
+            {
+                w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; i++)
+            {
+                uint32_t f, k;
+                if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+                else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+                else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+                else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+
+                uint32_t temp = rotate(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rotate(b, 30);
+                b = a;
+                a = temp;
+            }
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+        }
+
+        std::string digest;
+        for (auto value : h)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                digest += (char)(value >> shift);
+            }
+        }
+        return digest;
+    }
+
+    static std::string Base64(const std::string& input)
+    {
+        static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string output;
+        size_t i = 0;
+        for (; i + 2 < input.size(); i += 3)
+        {
+            uint32_t v = ((uint8_t)input[i] << 16) | ((uint8_t)input[i + 1] << 8) | (uint8_t)input[i + 2];
+            output += alphabet[(v >> 18) & 63];
+            output += alphabet[(v >> 12) & 63];
+            output += alphabet[(v >> 6) & 63];
+            output += alphabet[v & 63];
+        }
+        if (i < input.size())
+        {
+            uint32_t v = (uint8_t)input[i] << 16;
+            if (i + 1 < input.size())
+            {
+                v |= (uint8_t)input[i + 1] << 8;
+            }
+            output += alphabet[(v >> 18) & 63];
+            output += alphabet[(v >> 12) & 63];
+            output += (i + 1 < input.size()) ? alphabet[(v >> 6) & 63] : '=';
+            output += '=';
+        }
+        return output;
+    }
+
+    uint64_t m_phraseBytes;
+    int m_processingDelayMs;
+    int m_listenSocket = -1;
+    uint16_t m_port = 0;
+    std::atomic<bool> m_stopped{ false };
+    std::thread m_acceptThread;
+    std::mutex m_connectionsMutex;
+    std::list<ConnectionThread> m_connections;
+};
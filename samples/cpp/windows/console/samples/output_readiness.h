@@ -0,0 +1,328 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define SPX_HAVE_EPOLL
+#endif
+
+// Output of a speech synthesizer that can be read without blocking, and tells when there is something to read.
+//
+// PullAudioOutputStream::Read() waits until audio arrives, so every synthesis read that way needs a thread of its
+// own. This push stream callback buffers the audio the synthesizer writes instead, and signals readiness: on Linux
+// through an eventfd (readable while audio or the end of the stream is waiting), so that one epoll loop can serve any
+// number of streams; see AudioOutputPoller.
+//
+// The buffer grows as far as the synthesizer gets ahead of the reader, which for a slow reader can be the whole audio
+// of the synthesis. Give a high-water mark to bound it: Write() then waits while that much audio is unread, which holds
+// up the synthesizer instead.
+class ReadyAudioOutputStream final : public Microsoft::CognitiveServices::Speech::Audio::PushAudioOutputStreamCallback
+{
+public:
+    // 'maxBufferedBytes' is the high-water mark; 0 for none.
+    explicit ReadyAudioOutputStream(size_t maxBufferedBytes = 0)
+        : m_maxBufferedBytes(maxBufferedBytes)
+    {
+#if defined(SPX_HAVE_EPOLL)
+        m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventFd < 0)
+        {
+            throw std::runtime_error("Failed to create an eventfd.");
+        }
+#endif
+    }
+
+    ~ReadyAudioOutputStream()
+    {
+#if defined(SPX_HAVE_EPOLL)
+        close(m_eventFd);
+#endif
+    }
+
+    // Called by the synthesizer with audio; blocks only while the high-water mark is reached. Audio written after
+    // Close() is dropped.
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_maxBufferedBytes > 0)
+        {
+            m_drained.wait(lock, [this]() { return m_closed || m_buffer.size() - m_readPosition < m_maxBufferedBytes; });
+        }
+        if (!m_closed)
+        {
+            m_buffer.insert(m_buffer.end(), dataBuffer, dataBuffer + size);
+            Signal();
+        }
+        return (int)size;
+    }
+
+    // Called by the synthesizer when the stream ends. The application may call it, too, to end the stream early, e.g.
+    // once the synthesis result is ready (all audio has been written by then), or when giving up on it.
+    void Close() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        Signal();
+        m_drained.notify_all();
+    }
+
+    // Copies up to 'size' bytes of buffered audio to 'dataBuffer' and returns how many; 0 if there is none yet (or
+    // the stream is finished). Never blocks.
+    size_t Read(uint8_t* dataBuffer, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto count = std::min(size, m_buffer.size() - m_readPosition);
+        memcpy(dataBuffer, m_buffer.data() + m_readPosition, count);
+        m_readPosition += count;
+        if (m_readPosition == m_buffer.size())
+        {
+            // Drained: the buffer is reused, and the signal is reset unless the end is still to be reported. Writers
+            // signal under the same lock, so no wake-up is lost.
+            m_buffer.clear();
+            m_readPosition = 0;
+            if (!m_closed)
+            {
+                ClearSignal();
+            }
+        }
+        else if (m_readPosition >= compactBytes && m_readPosition >= m_buffer.size() / 2)
+        {
+            // A reader that keeps up without ever draining would otherwise leave the buffer growing.
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + (std::ptrdiff_t)m_readPosition);
+            m_readPosition = 0;
+        }
+        if (count > 0 && m_maxBufferedBytes > 0)
+        {
+            m_drained.notify_all();
+        }
+        return count;
+    }
+
+    // True once the stream is closed and all audio has been read.
+    bool IsFinished() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed && m_readPosition == m_buffer.size();
+    }
+
+#if defined(SPX_HAVE_EPOLL)
+    // The eventfd to wait on; readable while there is audio to read or the end of the stream to report.
+    int GetEventFd() const
+    {
+        return m_eventFd;
+    }
+#endif
+
+    // Sets a function called (under the stream's lock, so it must not call back into the stream) whenever the stream
+    // becomes ready. Used by AudioOutputPoller on platforms without eventfd.
+    void SetReadyCallback(std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_readyCallback = std::move(callback);
+    }
+
+private:
+    void Signal()
+    {
+#if defined(SPX_HAVE_EPOLL)
+        uint64_t one = 1;
+        (void)write(m_eventFd, &one, sizeof(one));
+#endif
+        if (m_readyCallback)
+        {
+            m_readyCallback();
+        }
+    }
+
+    void ClearSignal()
+    {
+#if defined(SPX_HAVE_EPOLL)
+        uint64_t count;
+        (void)read(m_eventFd, &count, sizeof(count));
+#endif
+    }
+
+    static constexpr size_t compactBytes = 64 * 1024;
+
+    size_t m_maxBufferedBytes;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_drained;      // Writers waiting for the high-water mark.
+    std::vector<uint8_t> m_buffer;
+    size_t m_readPosition = 0;
+    bool m_closed = false;
+    std::function<void()> m_readyCallback;
+#if defined(SPX_HAVE_EPOLL)
+    int m_eventFd = -1;
+#endif
+};
+
+// Drains many ReadyAudioOutputStreams from one thread: Poll() waits until any of them has audio and hands the audio
+// to the stream's handler. On Linux the streams' eventfds are watched with epoll, so a poll costs the same for ten
+// streams as for ten thousand. Elsewhere, streams report readiness to a condition variable and a poll visits all
+// streams.
+//
+// Add() and Poll() must be called from the same thread.
+class AudioOutputPoller final
+{
+public:
+    // Receives audio of a stream, in the order it was written.
+    typedef std::function<void(const uint8_t* data, size_t size)> DataHandler;
+    // Called once, after the last audio of a stream.
+    typedef std::function<void()> FinishedHandler;
+
+    AudioOutputPoller()
+    {
+#if defined(SPX_HAVE_EPOLL)
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epollFd < 0)
+        {
+            throw std::runtime_error("Failed to create an epoll instance.");
+        }
+#endif
+    }
+
+    ~AudioOutputPoller()
+    {
+        for (auto& entry : m_streams)
+        {
+            entry.second.Stream->SetReadyCallback(nullptr);
+        }
+#if defined(SPX_HAVE_EPOLL)
+        close(m_epollFd);
+#endif
+    }
+
+    void Add(std::shared_ptr<ReadyAudioOutputStream> stream, DataHandler onData, FinishedHandler onFinished = nullptr)
+    {
+        auto key = stream.get();
+        m_streams[key] = Entry{ stream, std::move(onData), std::move(onFinished) };
+#if defined(SPX_HAVE_EPOLL)
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = key;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream->GetEventFd(), &event) != 0)
+        {
+            m_streams.erase(key);
+            throw std::runtime_error("Failed to watch an output stream.");
+        }
+#else
+        stream->SetReadyCallback([this]()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready = true;
+            m_wakeUp.notify_one();
+        });
+        // It may have become ready before the callback was set.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = true;
+#endif
+    }
+
+    // Waits up to 'timeoutMs' (-1: no limit) until streams are ready, drains them, and removes finished ones.
+    // Returns the number of streams still open. A stream whose synthesizer never closes it keeps a Poll(-1) waiting;
+    // poll with a timeout and Close() such streams (e.g. once their synthesis results are ready).
+    size_t Poll(int timeoutMs)
+    {
+        if (m_streams.empty())
+        {
+            return 0;
+        }
+#if defined(SPX_HAVE_EPOLL)
+        epoll_event events[64];
+        auto count = epoll_wait(m_epollFd, events, 64, timeoutMs);
+        for (int i = 0; i < count; i++)
+        {
+            Drain((ReadyAudioOutputStream*)events[i].data.ptr);
+        }
+#else
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto ready = [this]() { return m_ready; };
+            if (timeoutMs < 0)
+            {
+                m_wakeUp.wait(lock, ready);
+            }
+            else
+            {
+                m_wakeUp.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+            }
+            m_ready = false;
+        }
+        std::vector<ReadyAudioOutputStream*> streams;
+        for (const auto& entry : m_streams)
+        {
+            streams.push_back(entry.first);
+        }
+        for (auto stream : streams)
+        {
+            Drain(stream);
+        }
+#endif
+        return m_streams.size();
+    }
+
+    size_t GetStreamCount() const
+    {
+        return m_streams.size();
+    }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<ReadyAudioOutputStream> Stream;
+        DataHandler OnData;
+        FinishedHandler OnFinished;
+    };
+
+    void Drain(ReadyAudioOutputStream* key)
+    {
+        auto& entry = m_streams[key];
+        size_t read;
+        while ((read = entry.Stream->Read(m_buffer, sizeof(m_buffer))) > 0)
+        {
+            entry.OnData(m_buffer, read);
+        }
+        if (entry.Stream->IsFinished())
+        {
+#if defined(SPX_HAVE_EPOLL)
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, entry.Stream->GetEventFd(), nullptr);
+#else
+            entry.Stream->SetReadyCallback(nullptr);
+#endif
+            if (entry.OnFinished)
+            {
+                entry.OnFinished();
+            }
+            m_streams.erase(key);
+        }
+    }
+
+    std::map<ReadyAudioOutputStream*, Entry> m_streams;
+    uint8_t m_buffer[64 * 1024];
+#if defined(SPX_HAVE_EPOLL)
+    int m_epollFd = -1;
+#else
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    bool m_ready = false;
+#endif
+};
@@ -0,0 +1,301 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPX_PCM_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SPX_PCM_NEON
+#endif
+
+#include "wav_file_reader.h"
+
+// Sample encodings of wav files, by format tag.
+enum class PcmEncoding : uint16_t
+{
+    Integer = 1,    // WAVE_FORMAT_PCM; 8-bit samples are unsigned, wider ones signed.
+    Float = 3,      // WAVE_FORMAT_IEEE_FLOAT.
+};
+
+// Compile-time description of a sample format. Sample rate and channel count pass through conversion unchanged, so
+// they stay run-time properties of the stream.
+template <uint16_t Bits, PcmEncoding Encoding>
+struct PcmFormat
+{
+    static constexpr uint16_t BitsPerSample = Bits;
+    static constexpr uint16_t BytesPerSample = Bits / 8;
+    static constexpr PcmEncoding SampleEncoding = Encoding;
+};
+
+using PcmUInt8 = PcmFormat<8, PcmEncoding::Integer>;
+using PcmInt16 = PcmFormat<16, PcmEncoding::Integer>;
+using PcmInt24 = PcmFormat<24, PcmEncoding::Integer>;
+using PcmInt32 = PcmFormat<32, PcmEncoding::Integer>;
+using PcmFloat32 = PcmFormat<32, PcmEncoding::Float>;
+using PcmFloat64 = PcmFormat<64, PcmEncoding::Float>;
+
+// Converts 'samples' samples of format 'Source' (little endian, any alignment) to 16-bit PCM.
+// One specialization per source format; each is a straight loop without per-sample branches.
+template <class Source>
+struct PcmToInt16;
+
+template <>
+struct PcmToInt16<PcmInt16>
+{
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        memcpy(target, source, samples * sizeof(int16_t));
+    }
+};
+
+template <>
+struct PcmToInt16<PcmUInt8>
+{
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            target[i] = (int16_t)((source[i] - 128) * 256);
+        }
+    }
+};
+
+template <>
+struct PcmToInt16<PcmInt24>
+{
+    // Keeps the upper 16 bits of each 3-byte sample.
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            target[i] = (int16_t)(source[3 * i + 1] | (source[3 * i + 2] << 8));
+        }
+    }
+};
+
+template <>
+struct PcmToInt16<PcmInt32>
+{
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        size_t i = 0;
+#if defined(SPX_PCM_SSE2)
+        for (; i + 8 <= samples; i += 8)
+        {
+            auto low = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(source + 4 * i)), 16);
+            auto high = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(source + 4 * i + 16)), 16);
+            _mm_storeu_si128((__m128i*)(target + i), _mm_packs_epi32(low, high));
+        }
+#elif defined(SPX_PCM_NEON)
+        for (; i + 8 <= samples; i += 8)
+        {
+            auto low = vshrn_n_s32(vreinterpretq_s32_u8(vld1q_u8(source + 4 * i)), 16);
+            auto high = vshrn_n_s32(vreinterpretq_s32_u8(vld1q_u8(source + 4 * i + 16)), 16);
+            vst1q_s16(target + i, vcombine_s16(low, high));
+        }
+#endif
+        for (; i < samples; i++)
+        {
+            int32_t sample;
+            memcpy(&sample, source + 4 * i, sizeof(sample));
+            target[i] = (int16_t)(sample >> 16);
+        }
+    }
+};
+
+template <>
+struct PcmToInt16<PcmFloat32>
+{
+    // Scales [-1, 1] to the 16-bit range, rounding to nearest and clipping values outside it.
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        size_t i = 0;
+#if defined(SPX_PCM_SSE2)
+        const auto scale = _mm_set1_ps(32768.0f);
+        const auto lowest = _mm_set1_ps(-32768.0f);
+        const auto highest = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= samples; i += 8)
+        {
+            auto low = _mm_mul_ps(_mm_loadu_ps((const float*)(source + 4 * i)), scale);
+            auto high = _mm_mul_ps(_mm_loadu_ps((const float*)(source + 4 * i + 16)), scale);
+            low = _mm_min_ps(_mm_max_ps(low, lowest), highest);
+            high = _mm_min_ps(_mm_max_ps(high, lowest), highest);
+            _mm_storeu_si128((__m128i*)(target + i), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+        }
+#elif defined(SPX_PCM_NEON)
+        const auto scale = vdupq_n_f32(32768.0f);
+        const auto lowest = vdupq_n_f32(-32768.0f);
+        const auto highest = vdupq_n_f32(32767.0f);
+        for (; i + 8 <= samples; i += 8)
+        {
+            auto low = vmulq_f32(vreinterpretq_f32_u8(vld1q_u8(source + 4 * i)), scale);
+            auto high = vmulq_f32(vreinterpretq_f32_u8(vld1q_u8(source + 4 * i + 16)), scale);
+            low = vminq_f32(vmaxq_f32(low, lowest), highest);
+            high = vminq_f32(vmaxq_f32(high, lowest), highest);
+            vst1q_s16(target + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(low)), vqmovn_s32(vcvtnq_s32_f32(high))));
+        }
+#endif
+        for (; i < samples; i++)
+        {
+            float sample;
+            memcpy(&sample, source + 4 * i, sizeof(sample));
+            target[i] = (int16_t)std::lrint(std::min(std::max(sample * 32768.0f, -32768.0f), 32767.0f));
+        }
+    }
+};
+
+template <>
+struct PcmToInt16<PcmFloat64>
+{
+    static void Convert(const uint8_t* source, int16_t* target, size_t samples)
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            double sample;
+            memcpy(&sample, source + 8 * i, sizeof(sample));
+            target[i] = (int16_t)std::lrint(std::min(std::max(sample * 32768.0, -32768.0), 32767.0));
+        }
+    }
+};
+
+// A converter chosen at run time, once per stream.
+typedef void (*PcmConvertFunction)(const uint8_t* source, int16_t* target, size_t samples);
+
+// Returns the converter from the given wav sample format to 16-bit PCM. Throws std::invalid_argument if not supported.
+inline PcmConvertFunction SelectPcmToInt16(uint16_t formatTag, uint16_t bitsPerSample)
+{
+    if (formatTag == (uint16_t)PcmEncoding::Integer)
+    {
+        switch (bitsPerSample)
+        {
+        case 8: return &PcmToInt16<PcmUInt8>::Convert;
+        case 16: return &PcmToInt16<PcmInt16>::Convert;
+        case 24: return &PcmToInt16<PcmInt24>::Convert;
+        case 32: return &PcmToInt16<PcmInt32>::Convert;
+        }
+    }
+    else if (formatTag == (uint16_t)PcmEncoding::Float)
+    {
+        switch (bitsPerSample)
+        {
+        case 32: return &PcmToInt16<PcmFloat32>::Convert;
+        case 64: return &PcmToInt16<PcmFloat64>::Convert;
+        }
+    }
+    throw std::invalid_argument("Unsupported sample format: format tag " + std::to_string(formatTag) + ", " + std::to_string(bitsPerSample) + " bits per sample.");
+}
+
+// Reads a wav file of any supported sample format and returns its audio as 16-bit PCM, the format the Speech SDK
+// expects, with the sample rate and channels of the file. Use it in place of WavFileReader.
+class Int16WavFileReader final
+{
+public:
+    Int16WavFileReader(const std::string& audioFileName)
+        : m_reader(audioFileName)
+    {
+        const auto& source = m_reader.GetFormat();
+        m_convert = SelectPcmToInt16(m_reader.GetSampleFormatTag(), source.BitsPerSample);
+        m_sourceBytesPerSample = source.BitsPerSample / 8;
+
+        m_format = source;
+        m_format.FormatTag = (uint16_t)PcmEncoding::Integer;
+        m_format.BitsPerSample = 16;
+        m_format.BlockAlign = (uint16_t)(source.Channels * sizeof(int16_t));
+        m_format.AvgBytesPerSec = source.SamplesPerSec * m_format.BlockAlign;
+    }
+
+    // Same as WavFileReader::Read(), for the converted audio. Returns 0 only at the end of the file: a request that
+    // ends within a frame (e.g. one smaller than BlockAlign) gets the start of it, and the next read starts with the rest.
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        // The rest of a frame split by the previous read.
+        uint32_t copied = 0;
+        if (m_splitPosition < m_split.size() * sizeof(int16_t))
+        {
+            copied = std::min(size, (uint32_t)(m_split.size() * sizeof(int16_t) - m_splitPosition));
+            memcpy(dataBuffer, (const uint8_t*)m_split.data() + m_splitPosition, copied);
+            m_splitPosition += copied;
+        }
+
+        // Whole frames are converted straight into the buffer; a partial one at the end is converted aside and split.
+        auto whole = (size - copied) / m_format.BlockAlign;
+        auto frames = whole + ((size - copied) % m_format.BlockAlign != 0 ? 1 : 0);
+        if (frames == 0)
+        {
+            return (int)copied;
+        }
+        m_source.resize(frames * m_format.Channels * m_sourceBytesPerSample);
+        auto read = m_reader.Read(m_source.data(), (uint32_t)m_source.size());
+        auto samples = (uint32_t)read / m_sourceBytesPerSample;
+
+        // After a split frame of odd size the output is misaligned for int16_t and goes through m_split.
+        auto direct = std::min(samples, whole * m_format.Channels);
+        auto output = dataBuffer + copied;
+        if ((uintptr_t)output % alignof(int16_t) == 0)
+        {
+            m_convert(m_source.data(), (int16_t*)output, direct);
+        }
+        else
+        {
+            m_split.resize(direct);
+            m_convert(m_source.data(), m_split.data(), direct);
+            memcpy(output, m_split.data(), direct * sizeof(int16_t));
+        }
+        copied += direct * sizeof(int16_t);
+
+        m_split.resize(samples - direct);
+        m_splitPosition = 0;
+        if (!m_split.empty())
+        {
+            m_convert(m_source.data() + direct * m_sourceBytesPerSample, m_split.data(), m_split.size());
+            m_splitPosition = std::min(size - copied, (uint32_t)(m_split.size() * sizeof(int16_t)));
+            memcpy(dataBuffer + copied, m_split.data(), m_splitPosition);
+            copied += (uint32_t)m_splitPosition;
+        }
+        return (int)copied;
+    }
+
+    void Seek(uint64_t frameIndex)
+    {
+        m_reader.Seek(frameIndex);
+        m_split.clear();
+        m_splitPosition = 0;
+    }
+
+    uint64_t GetFrameCount() const
+    {
+        return m_reader.GetFrameCount();
+    }
+
+    void Close()
+    {
+        m_reader.Close();
+    }
+
+    // Gets the format of the converted audio.
+    const WavFileReader::WAVEFORMAT& GetFormat() const
+    {
+        return m_format;
+    }
+
+private:
+    WavFileReader m_reader;
+    WavFileReader::WAVEFORMAT m_format;
+    PcmConvertFunction m_convert;
+    uint32_t m_sourceBytesPerSample;
+    std::vector<uint8_t> m_source;
+    std::vector<int16_t> m_split;       // A converted frame split between two reads.
+    size_t m_splitPosition = 0;         // Bytes of m_split returned so far.
+};
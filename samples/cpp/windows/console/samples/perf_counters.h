@@ -0,0 +1,143 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+// Hardware counter values of one measured region.
+struct PerfCounterValues
+{
+    uint64_t Cycles = 0;
+    uint64_t Instructions = 0;
+    uint64_t CacheMisses = 0;
+    uint64_t BranchMisses = 0;
+};
+
+// Reads cycles, instructions, cache misses and branch misses of the calling thread through perf_event_open.
+// The four counters are opened as one group so they are always scheduled together.
+// The counters are unavailable on platforms other than Linux, or when the kernel refuses access
+// (see /proc/sys/kernel/perf_event_paranoid); IsAvailable() then returns false and Stop() returns zeros.
+class PerfCounterGroup final
+{
+public:
+    PerfCounterGroup()
+    {
+#if defined(__linux__)
+        const uint64_t configs[counterCount] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        for (int i = 0; i < counterCount; i++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = (i == 0) ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            m_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : m_fds[0], 0);
+            if (m_fds[i] < 0)
+            {
+                m_error = std::string("perf_event_open failed: ") + strerror(errno);
+                CloseAll();
+                return;
+            }
+        }
+#else
+        m_error = "hardware performance counters are only supported on Linux";
+#endif
+    }
+
+    ~PerfCounterGroup()
+    {
+        CloseAll();
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool IsAvailable() const
+    {
+        return m_fds[0] >= 0;
+    }
+
+    // Gets the reason why the counters are unavailable.
+    const std::string& GetError() const
+    {
+        return m_error;
+    }
+
+    // Resets and starts counting.
+    void Start()
+    {
+#if defined(__linux__)
+        if (IsAvailable())
+        {
+            ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    // Stops counting and returns the values counted since Start().
+    PerfCounterValues Stop()
+    {
+        PerfCounterValues values;
+#if defined(__linux__)
+        if (IsAvailable())
+        {
+            ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+            // With PERF_FORMAT_GROUP the layout is { nr, value[nr] }.
+            uint64_t buffer[1 + counterCount] = {};
+            if (read(m_fds[0], buffer, sizeof(buffer)) == (ssize_t)sizeof(buffer))
+            {
+                values.Cycles = buffer[1];
+                values.Instructions = buffer[2];
+                values.CacheMisses = buffer[3];
+                values.BranchMisses = buffer[4];
+            }
+        }
+#endif
+        return values;
+    }
+
+private:
+    static constexpr int counterCount = 4;
+
+    void CloseAll()
+    {
+#if defined(__linux__)
+        for (int i = counterCount - 1; i >= 0; i--)
+        {
+            if (m_fds[i] >= 0)
+            {
+                close(m_fds[i]);
+                m_fds[i] = -1;
+            }
+        }
+#endif
+    }
+
+    int m_fds[counterCount] = { -1, -1, -1, -1 };
+    std::string m_error;
+};
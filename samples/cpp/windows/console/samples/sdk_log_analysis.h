@@ -0,0 +1,247 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Gives every session its own SDK log file (PropertyId::Speech_LogFilename), reusing a fixed number of files round
+// robin, so logging can stay enabled without filling the disk.
+//
+// SDK logging is process wide: the file set for a recognizer receives the logs of everything running in the
+// process from then on. Use one logged session at a time to get one session per file.
+class SdkLogRotation final
+{
+public:
+    SdkLogRotation(const std::string& filePrefix = "speech-sdk", size_t fileCount = 5)
+        : m_filePrefix(filePrefix), m_fileCount(std::max<size_t>(1, fileCount))
+    {
+    }
+
+    // Sets the next log file on 'config' (to take effect for recognizers created from it), removing what the file
+    // held before. Returns the file name.
+    std::string EnableForSession(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config)
+    {
+        auto fileName = m_filePrefix + "-" + std::to_string(m_nextFile) + ".log";
+        m_nextFile = (m_nextFile + 1) % m_fileCount;
+        std::remove(fileName.c_str());
+        config->SetProperty(Microsoft::CognitiveServices::Speech::PropertyId::Speech_LogFilename, fileName);
+        return fileName;
+    }
+
+private:
+    std::string m_filePrefix;
+    size_t m_fileCount;
+    size_t m_nextFile = 0;
+};
+
+// What to look for in an SDK log. Message patterns match whole words at the start of a line's message, so that e.g. a
+// line that only mentions a retry count is not taken for a retry; AudioPumpSource matches anywhere in the source file
+// name. The defaults fit the messages of current SDK versions and can be adjusted if they change.
+struct SdkLogPatterns
+{
+    std::vector<std::string> ConnectionStart = { "Start to open websocket", "Opening websocket" };
+    std::vector<std::string> ConnectionOpen = { "OnWebSocketOpened", "WebSocket open", "websocket connected" };
+    std::vector<std::string> Retry = { "Retry", "retry", "Retrying", "retrying", "Reconnect", "reconnect", "Reconnecting", "reconnecting" };
+    std::vector<std::string> AudioPumpSource = { "audio_pump", "AudioPump", "pull_audio", "push_audio" };
+    double AudioPumpStallMs = 500;      // A gap between two audio pump lines longer than this is a stall.
+    size_t MaxErrorMessages = 10;       // Error lines kept verbatim in the summary.
+};
+
+// What a session log says, in a few numbers.
+struct SdkLogSummary
+{
+    uint64_t Lines = 0;
+    uint64_t Bytes = 0;
+    double DurationMs = 0;                      // From the first to the last timestamp.
+    std::vector<double> ConnectionSetupMs;      // One per connection opened.
+    uint64_t AudioPumpStalls = 0;
+    double LongestAudioPumpStallMs = 0;
+    uint64_t Retries = 0;
+    uint64_t Warnings = 0;
+    uint64_t Errors = 0;
+    std::vector<std::string> ErrorMessages;     // The first few.
+};
+
+// Parses an SDK log in a single pass over large blocks, without regular expressions and without keeping lines, so
+// a log of hundreds of megabytes is summarized in about the time it takes to read it.
+//
+// Lines look like "[thread]: 1234ms SPX_TRACE_INFO:  file.cpp:56 message"; lines that do not are counted and skipped.
+inline SdkLogSummary ParseSdkLog(const std::string& fileName, const SdkLogPatterns& patterns = SdkLogPatterns())
+{
+    std::ifstream file(fileName, std::ios_base::binary);
+    if (!file.good())
+    {
+        throw std::invalid_argument("Failed to open the SDK log " + fileName + ".");
+    }
+
+    SdkLogSummary summary;
+    auto contains = [](const char* begin, const char* end, const std::vector<std::string>& needles)
+    {
+        for (const auto& needle : needles)
+        {
+            if (std::search(begin, end, needle.begin(), needle.end()) != end)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto startsWith = [](const char* begin, const char* end, const std::vector<std::string>& prefixes)
+    {
+        for (const auto& prefix : prefixes)
+        {
+            if ((size_t)(end - begin) >= prefix.size() && std::equal(prefix.begin(), prefix.end(), begin))
+            {
+                // The prefix must end at a word boundary.
+                auto next = begin + prefix.size();
+                if (next == end || !(isalnum((unsigned char)*next) || *next == '_'))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+
+    bool haveTime = false, connecting = false, havePumpTime = false;
+    double firstTime = 0, lastTime = 0, connectionStart = 0, lastPumpTime = 0;
+    auto parseLine = [&](const char* begin, const char* end)
+    {
+        summary.Lines++;
+
+        // The timestamp: the first number after the thread id, followed by "ms".
+        auto p = begin < end && *begin == '[' ? std::find(begin, end, ']') : begin;
+        while (p < end && (*p < '0' || *p > '9'))
+        {
+            p++;
+        }
+        double time = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            time = time * 10 + (*p - '0');
+        }
+        if (end - p < 2 || p[0] != 'm' || p[1] != 's')
+        {
+            return;
+        }
+
+        // The level, e.g. "SPX_TRACE_ERROR:", and the source location; the message follows the location.
+        auto level = std::search(p, end, "SPX_", "SPX_" + 4);
+        auto levelEnd = std::find(level, end, ':');
+        auto source = levelEnd + (levelEnd < end ? 1 : 0);
+        while (source < end && *source == ' ')
+        {
+            source++;
+        }
+        auto sourceEnd = std::find(source, end, ' ');
+        auto message = sourceEnd;
+        while (message < end && *message == ' ')
+        {
+            message++;
+        }
+        if (std::search(level, levelEnd, "ERROR", "ERROR" + 5) != levelEnd)
+        {
+            summary.Errors++;
+            if (summary.ErrorMessages.size() < patterns.MaxErrorMessages)
+            {
+                summary.ErrorMessages.emplace_back(source, end);
+            }
+        }
+        else if (std::search(level, levelEnd, "WARNING", "WARNING" + 7) != levelEnd)
+        {
+            summary.Warnings++;
+        }
+
+        if (!haveTime)
+        {
+            firstTime = time;
+            haveTime = true;
+        }
+        lastTime = std::max(lastTime, time);
+
+        if (startsWith(message, end, patterns.ConnectionStart))
+        {
+            connectionStart = time;
+            connecting = true;
+        }
+        else if (connecting && startsWith(message, end, patterns.ConnectionOpen))
+        {
+            summary.ConnectionSetupMs.push_back(time - connectionStart);
+            connecting = false;
+        }
+        if (startsWith(message, end, patterns.Retry))
+        {
+            summary.Retries++;
+        }
+        if (contains(source, sourceEnd, patterns.AudioPumpSource))
+        {
+            if (havePumpTime && time - lastPumpTime > patterns.AudioPumpStallMs)
+            {
+                summary.AudioPumpStalls++;
+                summary.LongestAudioPumpStallMs = std::max(summary.LongestAudioPumpStallMs, time - lastPumpTime);
+            }
+            lastPumpTime = time;
+            havePumpTime = true;
+        }
+    };
+
+    // Lines are cut out of 1 MB blocks; a line split across two blocks is carried over.
+    std::vector<char> block(1 << 20);
+    std::string carry;
+    while (file.good())
+    {
+        file.read(block.data(), (std::streamsize)block.size());
+        auto size = (size_t)file.gcount();
+        summary.Bytes += size;
+        const char* p = block.data();
+        const char* end = p + size;
+        while (p < end)
+        {
+            auto newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (newline == nullptr)
+            {
+                carry.append(p, end);
+                break;
+            }
+            if (!carry.empty())
+            {
+                carry.append(p, newline);
+                parseLine(carry.data(), carry.data() + carry.size());
+                carry.clear();
+            }
+            else
+            {
+                parseLine(p, newline);
+            }
+            p = newline + 1;
+        }
+    }
+    if (!carry.empty())
+    {
+        parseLine(carry.data(), carry.data() + carry.size());
+    }
+
+    summary.DurationMs = lastTime - firstTime;
+    return summary;
+}
+
+// Parses an SDK log on a thread of its own, so that the caller (e.g. an event handler of the SDK) is not held up.
+// Start it only when the log is complete: after logging has moved on to another file (a recognizer was created with
+// the next one), or after the session's recognizer is gone.
+inline std::future<SdkLogSummary> ParseSdkLogAsync(const std::string& fileName, const SdkLogPatterns& patterns = SdkLogPatterns())
+{
+    return std::async(std::launch::async, [fileName, patterns]() { return ParseSdkLog(fileName, patterns); });
+}
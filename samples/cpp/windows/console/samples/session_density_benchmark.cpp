@@ -0,0 +1,371 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Session density benchmark: how many continuous recognition sessions one host sustains before latency degrades.
+// Concurrent SpeechRecognizer sessions, each fed by a pull stream paced at real time, are ramped up in steps against
+// a local mock service (or the host given with --host). For every step it records RSS, thread count, CPU and result
+// latency, and reports the knee point. Before the ramp, the memory of idle and active sessions is broken out.
+//
+// Usage: session_density_benchmark [--host ws://127.0.0.1:<port>] [--file whatstheweatherlike.wav]
+//                                  [--step 16] [--max-sessions 512] [--step-seconds 20] [--knee-factor 2]
+//
+
+#include "stdafx.h"
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "wav_file_reader.h"
+#include "mock_speech_service.h"
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+namespace
+{
+    // Reads a "Name:   value" line of /proc/self/status.
+    uint64_t ReadProcStatus(const string& name)
+    {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line))
+        {
+            if (line.compare(0, name.size(), name) == 0 && line.size() > name.size() && line[name.size()] == ':')
+            {
+                return stoull(line.substr(name.size() + 1));
+            }
+        }
+        return 0;
+    }
+
+    uint64_t ResidentBytes()
+    {
+        return ReadProcStatus("VmRSS") * 1024;
+    }
+
+    uint64_t ThreadCount()
+    {
+        return ReadProcStatus("Threads");
+    }
+
+    double CpuSeconds()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+
+    double Percentile(vector<double> values, double percentile)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        sort(values.begin(), values.end());
+        auto index = (size_t)(percentile / 100.0 * (values.size() - 1));
+        return values[index];
+    }
+
+    // Collects result latencies of all sessions; reset at every ramp step.
+    class LatencyCollector final
+    {
+    public:
+        void Add(double latencyMs)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_latencies.push_back(latencyMs);
+        }
+
+        vector<double> TakeAll()
+        {
+            lock_guard<mutex> lock(m_mutex);
+            vector<double> latencies;
+            latencies.swap(m_latencies);
+            return latencies;
+        }
+
+    private:
+        mutex m_mutex;
+        vector<double> m_latencies;
+    };
+
+    // Feeds the audio of a file at real-time speed, looping over it until the session is stopped.
+    class PacedAudioCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        PacedAudioCallback(shared_ptr<const vector<uint8_t>> audio, uint32_t bytesPerSecond)
+            : m_audio(audio), m_bytesPerSecond(bytesPerSecond)
+        {
+        }
+
+        // Starts the audio clock; audio at offset t is delivered at GetStartTime() + t.
+        void StartClock()
+        {
+            m_start = chrono::steady_clock::now();
+        }
+
+        chrono::steady_clock::time_point GetStartTime() const
+        {
+            return m_start;
+        }
+
+        void Stop()
+        {
+            m_stopped = true;
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            // Wait until at least 'size' bytes (capped to 100 ms of audio) are due.
+            size = min(size, m_bytesPerSecond / 10);
+            while (!m_stopped)
+            {
+                auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+                auto due = (uint64_t)(elapsed * m_bytesPerSecond);
+                if (due >= m_delivered + size)
+                {
+                    break;
+                }
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+            if (m_stopped)
+            {
+                return 0;
+            }
+
+            for (uint32_t copied = 0; copied < size;)
+            {
+                auto position = (size_t)(m_delivered % m_audio->size());
+                auto chunk = min((size_t)(size - copied), m_audio->size() - position);
+                memcpy(dataBuffer + copied, m_audio->data() + position, chunk);
+                copied += (uint32_t)chunk;
+                m_delivered += chunk;
+            }
+            return (int)size;
+        }
+
+        void Close() override
+        {
+            m_stopped = true;
+        }
+
+    private:
+        shared_ptr<const vector<uint8_t>> m_audio;
+        uint32_t m_bytesPerSecond;
+        uint64_t m_delivered = 0;
+        atomic<bool> m_stopped{ false };
+        chrono::steady_clock::time_point m_start = chrono::steady_clock::now();
+    };
+
+    // One recognition session fed by a paced pull stream.
+    struct Session
+    {
+        shared_ptr<PacedAudioCallback> Callback;
+        shared_ptr<AudioConfig> AudioInput;
+        shared_ptr<SpeechRecognizer> Recognizer;
+    };
+
+    Session CreateStream(shared_ptr<const vector<uint8_t>> audio, uint32_t bytesPerSecond)
+    {
+        Session session;
+        session.Callback = make_shared<PacedAudioCallback>(audio, bytesPerSecond);
+        session.AudioInput = AudioConfig::FromStreamInput(AudioInputStream::CreatePullStream(session.Callback));
+        return session;
+    }
+
+    void CreateRecognizer(Session& session, const shared_ptr<SpeechConfig>& config, LatencyCollector& latencies)
+    {
+        session.Recognizer = SpeechRecognizer::FromConfig(config, session.AudioInput);
+
+        auto callback = session.Callback;
+        session.Recognizer->Recognized.Connect([callback, &latencies](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                // The end of the phrase was delivered at start + offset + duration; the rest is latency.
+                auto phraseEnd = callback->GetStartTime() + chrono::microseconds((e.Result->Offset() + e.Result->Duration()) / 10);
+                latencies.Add(chrono::duration<double, milli>(chrono::steady_clock::now() - phraseEnd).count());
+            }
+        });
+    }
+
+    void StartSession(Session& session)
+    {
+        session.Callback->StartClock();
+        session.Recognizer->StartContinuousRecognitionAsync().get();
+    }
+
+    void StopSessions(vector<Session>& sessions)
+    {
+        for (auto& session : sessions)
+        {
+            session.Callback->Stop();
+        }
+        for (auto& session : sessions)
+        {
+            if (session.Recognizer)
+            {
+                session.Recognizer->StopContinuousRecognitionAsync().get();
+            }
+        }
+        sessions.clear();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    string host;
+    string fileName = "whatstheweatherlike.wav";
+    size_t step = 16;
+    size_t maxSessions = 512;
+    int stepSeconds = 20;
+    double kneeFactor = 2.0;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        string value = argv[i + 1];
+        if (arg == "--host") host = value;
+        else if (arg == "--file") fileName = value;
+        else if (arg == "--step") step = stoul(value);
+        else if (arg == "--max-sessions") maxSessions = stoul(value);
+        else if (arg == "--step-seconds") stepSeconds = stoi(value);
+        else if (arg == "--knee-factor") kneeFactor = stod(value);
+    }
+
+    pid_t mockPid = 0;
+    int exitCode = 0;
+    try
+    {
+        if (host.empty())
+        {
+            mockPid = MockSpeechService::StartInChildProcess(&host);
+        }
+        cout << "Service: " << host << endl;
+
+        // Loads the audio once; all sessions share it read-only.
+        WavFileReader reader(fileName);
+        auto bytesPerSecond = reader.GetFormat().AvgBytesPerSec;
+        auto audio = make_shared<vector<uint8_t>>();
+        vector<uint8_t> buffer(4096);
+        int read = 0;
+        while ((read = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
+        {
+            audio->insert(audio->end(), buffer.data(), buffer.data() + read);
+        }
+
+        auto config = SpeechConfig::FromHost(host);
+        LatencyCollector latencies;
+
+        // Memory breakdown: 'step' sessions are built up component by component.
+        {
+            vector<Session> sessions;
+            auto rssStart = ResidentBytes();
+            for (size_t i = 0; i < step; i++)
+            {
+                sessions.push_back(CreateStream(audio, bytesPerSecond));
+            }
+            auto rssStreams = ResidentBytes();
+            for (auto& session : sessions)
+            {
+                CreateRecognizer(session, config, latencies);
+            }
+            auto rssIdle = ResidentBytes();
+            for (auto& session : sessions)
+            {
+                StartSession(session);
+            }
+            this_thread::sleep_for(chrono::seconds(5));
+            auto rssActive = ResidentBytes();
+            StopSessions(sessions);
+            latencies.TakeAll();
+
+            cout << "\nMemory per session (average over " << step << " sessions):\n"
+                 << "  pull stream and audio config: " << (int64_t)(rssStreams - rssStart) / (int64_t)step / 1024 << " KiB\n"
+                 << "  idle recognizer:              " << (int64_t)(rssIdle - rssStreams) / (int64_t)step / 1024 << " KiB\n"
+                 << "  active session:               " << (int64_t)(rssActive - rssIdle) / (int64_t)step / 1024 << " KiB\n";
+        }
+
+        // Ramp. Memory per session is counted from here, so the SDK's one-time allocations are left out.
+        auto rssBaseline = ResidentBytes();
+        cout << "\nsessions   rss(MiB)  threads  cpu(cores)  results  p50(ms)  p95(ms)\n";
+        vector<Session> sessions;
+        double baselineP95 = 0;
+        size_t kneeSessions = 0;
+        double kneeCores = 0;
+        uint64_t kneeRss = 0;
+        while (sessions.size() < maxSessions)
+        {
+            for (size_t i = 0; i < step && sessions.size() < maxSessions; i++)
+            {
+                sessions.push_back(CreateStream(audio, bytesPerSecond));
+                CreateRecognizer(sessions.back(), config, latencies);
+                StartSession(sessions.back());
+            }
+
+            // Lets the sessions settle, then measures a full step.
+            this_thread::sleep_for(chrono::seconds(2));
+            latencies.TakeAll();
+            auto cpuStart = CpuSeconds();
+            auto wallStart = chrono::steady_clock::now();
+            this_thread::sleep_for(chrono::seconds(stepSeconds));
+            auto cores = (CpuSeconds() - cpuStart) / chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+            auto stepLatencies = latencies.TakeAll();
+            auto rss = ResidentBytes();
+            auto p95 = Percentile(stepLatencies, 95);
+
+            printf("%8zu %10.1f %8llu %11.2f %8zu %8.1f %8.1f\n", sessions.size(), rss / 1048576.0, (unsigned long long)ThreadCount(),
+                cores, stepLatencies.size(), Percentile(stepLatencies, 50), p95);
+            fflush(stdout);
+
+            if (baselineP95 == 0)
+            {
+                baselineP95 = max(p95, 1.0);
+            }
+            if (stepLatencies.empty() || p95 > baselineP95 * kneeFactor)
+            {
+                break;
+            }
+            kneeSessions = sessions.size();
+            kneeCores = cores;
+            kneeRss = rss;
+        }
+        StopSessions(sessions);
+
+        if (kneeSessions == 0)
+        {
+            cout << "\nLatency degraded at the first step; reduce --step." << endl;
+        }
+        else
+        {
+            auto sessionBytes = kneeRss > rssBaseline ? kneeRss - rssBaseline : 0;
+            cout << "\nKnee: " << kneeSessions << " sessions before p95 latency exceeded " << kneeFactor << "x the first step.\n"
+                 << "  sessions per core: " << (kneeCores > 0 ? kneeSessions / kneeCores : 0) << "\n"
+                 << "  sessions per GiB:  " << (sessionBytes > 0 ? kneeSessions / (sessionBytes / 1073741824.0) : 0)
+                 << " (RSS growth over the ramp, without the process baseline of " << rssBaseline / 1048576 << " MiB)" << endl;
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << endl;
+        exitCode = 1;
+    }
+
+    if (mockPid > 0)
+    {
+        kill(mockPid, SIGTERM);
+        waitpid(mockPid, nullptr, 0);
+    }
+    return exitCode;
+}
@@ -0,0 +1,301 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A speaker turn: the time span of one transcribed result, in ticks of 100 ns, and its speaker.
+struct SpeakerTurn
+{
+    uint64_t Start;
+    uint64_t End;
+    std::string Speaker;
+};
+
+// Timeline of the speaker turns of a conversation, built as Transcribed results arrive.
+//
+// Turns are kept in an interval tree: a balanced (AVL) binary search tree ordered by start time, where every node
+// also holds the latest end time in its subtree. Subtrees that end before a query span, or start after it, are
+// skipped, so a query that matches k turns visits O((k + 1) log n) nodes (never more than n), and an insert takes
+// O((k + 1) log n) for the k turns it overlaps. Talk time per speaker and total overlapped time are kept up to date on
+// insert and read in O(1).
+//
+// All members are thread-safe, so the timeline can be read (e.g. polled for statistics) while results still arrive.
+class SpeakerTimeline final
+{
+public:
+    // Adds a turn, e.g. from a Transcribed result's Offset(), Duration() and UserId.
+    void Add(uint64_t offset, uint64_t duration, const std::string& speaker)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto speakerIndex = GetSpeakerIndex(speaker);
+        auto end = offset + duration;
+
+        // Time overlapped with other speakers' turns, counted once per pair of turns.
+        Visit(m_root, offset, end, [this, offset, end, speakerIndex](const Node& node)
+        {
+            if (node.Speaker != speakerIndex)
+            {
+                m_overlapTicks += std::min(end, node.End) - std::max(offset, node.Start);
+            }
+        });
+
+        m_nodes.push_back(Node{ offset, end, end, speakerIndex, 1, None, None });
+        m_root = Insert(m_root, (uint32_t)m_nodes.size() - 1);
+        m_talkTicks[speakerIndex] += duration;
+        m_duration = std::max(m_duration, end);
+    }
+
+    // Speakers talking at time t (ticks).
+    std::vector<std::string> SpeakersAt(uint64_t t) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::string> speakers;
+        Visit(m_root, t, t + 1, [this, &speakers](const Node& node)
+        {
+            const auto& speaker = m_speakers[node.Speaker];
+            if (std::find(speakers.begin(), speakers.end(), speaker) == speakers.end())
+            {
+                speakers.push_back(speaker);
+            }
+        });
+        return speakers;
+    }
+
+    // Turns that overlap the span [start, end), in ticks.
+    std::vector<SpeakerTurn> TurnsBetween(uint64_t start, uint64_t end) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<SpeakerTurn> turns;
+        Visit(m_root, start, end, [this, &turns](const Node& node)
+        {
+            turns.push_back(SpeakerTurn{ node.Start, node.End, m_speakers[node.Speaker] });
+        });
+        return turns;
+    }
+
+    // Whether more than one speaker talks during any part of [start, end). Linear in the number of turns in the span.
+    bool HasOverlap(uint64_t start, uint64_t end) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // The turns come in order of start time, so a turn overlaps an earlier one of another speaker if that one ends
+        // after it starts. It is enough to remember the latest end of any speaker and the latest end of any speaker
+        // other than that one.
+        bool overlap = false;
+        uint64_t latestEnd = 0, otherLatestEnd = 0;
+        uint32_t latestSpeaker = None;
+        Visit(m_root, start, end, [start, end, &overlap, &latestEnd, &otherLatestEnd, &latestSpeaker](const Node& node)
+        {
+            auto turnStart = std::max(start, node.Start);
+            auto turnEnd = std::min(end, node.End);
+            auto previousEnd = node.Speaker != latestSpeaker ? latestEnd : otherLatestEnd;
+            if (latestSpeaker != None && previousEnd > turnStart)
+            {
+                overlap = true;
+            }
+
+            if (node.Speaker == latestSpeaker)
+            {
+                latestEnd = std::max(latestEnd, turnEnd);
+            }
+            else if (turnEnd > latestEnd)
+            {
+                otherLatestEnd = latestEnd;
+                latestEnd = turnEnd;
+                latestSpeaker = node.Speaker;
+            }
+            else
+            {
+                otherLatestEnd = std::max(otherLatestEnd, turnEnd);
+            }
+        });
+        return overlap;
+    }
+
+    // Total talk time of a speaker, in ticks.
+    uint64_t GetTalkTime(const std::string& speaker) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto index = m_speakerIndices.find(speaker);
+        return index == m_speakerIndices.end() ? 0 : m_talkTicks[index->second];
+    }
+
+    // Talk time of every speaker, in ticks.
+    std::vector<std::pair<std::string, uint64_t>> GetTalkTimes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::pair<std::string, uint64_t>> talkTimes;
+        for (size_t i = 0; i < m_speakers.size(); i++)
+        {
+            talkTimes.emplace_back(m_speakers[i], m_talkTicks[i]);
+        }
+        return talkTimes;
+    }
+
+    // Time in which two speakers talked at once, summed over all pairs of overlapping turns, in ticks.
+    uint64_t GetOverlapTime() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_overlapTicks;
+    }
+
+    // End of the latest turn, in ticks.
+    uint64_t GetDuration() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_duration;
+    }
+
+    size_t GetTurnCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_nodes.size();
+    }
+
+private:
+    static constexpr uint32_t None = UINT32_MAX;
+
+    // Nodes live in one vector and refer to each other by index, which keeps the tree compact and cheap to grow.
+    struct Node
+    {
+        uint64_t Start;
+        uint64_t End;
+        uint64_t MaxEnd; // Latest end time in the subtree.
+        uint32_t Speaker;
+        int32_t Height;
+        uint32_t Left;
+        uint32_t Right;
+    };
+
+    uint32_t GetSpeakerIndex(const std::string& speaker)
+    {
+        auto index = m_speakerIndices.emplace(speaker, (uint32_t)m_speakers.size());
+        if (index.second)
+        {
+            m_speakers.push_back(speaker);
+            m_talkTicks.push_back(0);
+        }
+        return index.first->second;
+    }
+
+    int32_t Height(uint32_t node) const
+    {
+        return node == None ? 0 : m_nodes[node].Height;
+    }
+
+    void Update(uint32_t node)
+    {
+        auto& n = m_nodes[node];
+        n.Height = 1 + std::max(Height(n.Left), Height(n.Right));
+        n.MaxEnd = n.End;
+        if (n.Left != None)
+        {
+            n.MaxEnd = std::max(n.MaxEnd, m_nodes[n.Left].MaxEnd);
+        }
+        if (n.Right != None)
+        {
+            n.MaxEnd = std::max(n.MaxEnd, m_nodes[n.Right].MaxEnd);
+        }
+    }
+
+    uint32_t RotateRight(uint32_t node)
+    {
+        auto left = m_nodes[node].Left;
+        m_nodes[node].Left = m_nodes[left].Right;
+        m_nodes[left].Right = node;
+        Update(node);
+        Update(left);
+        return left;
+    }
+
+    uint32_t RotateLeft(uint32_t node)
+    {
+        auto right = m_nodes[node].Right;
+        m_nodes[node].Right = m_nodes[right].Left;
+        m_nodes[right].Left = node;
+        Update(node);
+        Update(right);
+        return right;
+    }
+
+    // Inserts 'added' into the subtree of 'node' and returns the new subtree root.
+    uint32_t Insert(uint32_t node, uint32_t added)
+    {
+        if (node == None)
+        {
+            return added;
+        }
+
+        // Results mostly arrive in time order, so without rebalancing the tree would degrade into a list.
+        if (m_nodes[added].Start < m_nodes[node].Start)
+        {
+            m_nodes[node].Left = Insert(m_nodes[node].Left, added);
+        }
+        else
+        {
+            m_nodes[node].Right = Insert(m_nodes[node].Right, added);
+        }
+        Update(node);
+
+        auto balance = Height(m_nodes[node].Left) - Height(m_nodes[node].Right);
+        if (balance > 1)
+        {
+            if (Height(m_nodes[m_nodes[node].Left].Left) < Height(m_nodes[m_nodes[node].Left].Right))
+            {
+                m_nodes[node].Left = RotateLeft(m_nodes[node].Left);
+            }
+            return RotateRight(node);
+        }
+        if (balance < -1)
+        {
+            if (Height(m_nodes[m_nodes[node].Right].Right) < Height(m_nodes[m_nodes[node].Right].Left))
+            {
+                m_nodes[node].Right = RotateRight(m_nodes[node].Right);
+            }
+            return RotateLeft(node);
+        }
+        return node;
+    }
+
+    // Calls 'visit(node)' for every turn that overlaps [start, end), in order of start time. Every reported turn costs
+    // at most a path from the root; subtrees without one are cut off by MaxEnd or by their start.
+    template <class Visitor>
+    void Visit(uint32_t node, uint64_t start, uint64_t end, Visitor visit) const
+    {
+        // Nothing in this subtree ends after the span starts.
+        if (node == None || m_nodes[node].MaxEnd <= start)
+        {
+            return;
+        }
+        const auto& n = m_nodes[node];
+        Visit(n.Left, start, end, visit);
+
+        // Everything to the right starts at or after this node.
+        if (n.Start >= end)
+        {
+            return;
+        }
+        if (n.End > start)
+        {
+            visit(n);
+        }
+        Visit(n.Right, start, end, visit);
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<Node> m_nodes;
+    uint32_t m_root = None;
+    std::vector<std::string> m_speakers;
+    std::unordered_map<std::string, uint32_t> m_speakerIndices;
+    std::vector<uint64_t> m_talkTicks;
+    uint64_t m_overlapTicks = 0;
+    uint64_t m_duration = 0;
+};
@@ -8,7 +8,19 @@
 // <toplevel>
 #include <speechapi_cxx.h>
 #include <fstream>
+#include <thread>
 #include "wav_file_reader.h"
+#include "trace_events.h"
+#include "keyword_model_cache.h"
+#include "transcript_index.h"
+#include "beamformer.h"
+#include "pcm_format.h"
+#include "windowed_recognition.h"
+#include "audio_preflight.h"
+#include "audio_tee.h"
+#include "detailed_result_json.h"
+#include "latency_breakdown.h"
+#include "sdk_log_analysis.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -67,8 +79,9 @@ void SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat()
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    // Request detailed output format.
+    // Request detailed output format, with the timing of every word.
     config->SetOutputFormat(OutputFormat::Detailed);
+    config->RequestWordLevelTimestamps();
 
     // Creates a speech recognizer in the specified language using microphone as audio input.
     // Replace the language with your language in BCP-47 format, e.g. en-US.
@@ -90,6 +103,19 @@ void SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat()
         cout << "RECOGNIZED: Text=" << result->Text << std::endl
              << "  Speech Service JSON: " << result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult)
              << std::endl;
+
+        // Reads the alternatives and word timings from the JSON, decoding only the fields used.
+        DetailedResultParser parser;
+        parser.Parse(result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult));
+        for (size_t i = 0; i < parser.GetAlternativeCount(); i++)
+        {
+            auto alternative = parser.GetAlternative(i);
+            cout << "  ALTERNATIVE " << i + 1 << ": Confidence=" << alternative.Confidence() << ", Lexical=" << alternative.Lexical() << std::endl;
+            alternative.ForEachWord([](const DetailedWord& word)
+            {
+                cout << "    " << word.Word() << " at " << word.Offset() / 10000 << " ms for " << word.Duration() / 10000 << " ms" << std::endl;
+            });
+        }
     }
     else if (result->Reason == ResultReason::NoMatch)
     {
@@ -254,8 +280,15 @@ void SpeechContinuousRecognitionWithPullStream()
             m_reader.Close();
         }
 
+        // Gets the format of the audio returned by Read().
+        const WavFileReader::WAVEFORMAT& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
     private:
-        WavFileReader m_reader;
+        // Converts 8, 24 and 32-bit integer and float samples to the 16-bit samples the stream carries.
+        Int16WavFileReader m_reader;
     };
 
     // Creates an instance of a speech config with specified subscription key and service region.
@@ -263,10 +296,15 @@ void SpeechContinuousRecognitionWithPullStream()
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
     // Creates a callback that will read audio data from a WAV file.
-    // Currently, the only supported WAV format is mono(single channel), 16 kHZ sample rate, 16 bits per sample.
+    // The file may have any PCM or IEEE float sample format; the stream gets 16 bits per sample at the file's rate and channels.
     // Replace with your own audio file name.
     auto callback = make_shared<AudioInputFromFileCallback>("whatstheweatherlike.wav");
-    auto pullStream = AudioInputStream::CreatePullStream(callback);
+    const auto& format = callback->GetFormat();
+
+    // Keeps an archive of exactly the audio the recognizer reads, written in the background.
+    auto archive = make_shared<AudioArchiveWriter>("pullstream-archive.wav", format);
+    auto teeCallback = make_shared<TeePullAudioInputStreamCallback>(callback, archive);
+    auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(format.SamplesPerSec, 16, (unsigned char)format.Channels), teeCallback);
 
     // Creates a speech recognizer from stream input;
     auto audioInput = AudioConfig::FromStreamInput(pullStream);
@@ -328,6 +366,18 @@ void SpeechContinuousRecognitionWithPullStream()
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().wait();
+
+    // Completes the archive (the stream may not have been closed if recognition was canceled), and reports whether
+    // all of it could be written.
+    try
+    {
+        archive->Close();
+    }
+    catch (const runtime_error& e)
+    {
+        cout << e.what() << std::endl;
+    }
+    cout << "Archived " << archive->GetBytesWritten() << " bytes of audio to pullstream-archive.wav." << std::endl;
 }
 
 void SpeechContinuousRecognitionWithPushStream()
@@ -394,6 +444,9 @@ void SpeechContinuousRecognitionWithPushStream()
 
     WavFileReader reader("whatstheweatherlike.wav");
 
+    // Everything pushed to the recognizer is also archived, written in the background.
+    TeePushAudioInputStream teeStream(pushStream, make_shared<AudioArchiveWriter>("pushstream-archive.wav", reader.GetFormat()));
+
     vector<uint8_t> buffer(1000);
 
     // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
@@ -404,11 +457,18 @@ void SpeechContinuousRecognitionWithPushStream()
     while((readSamples = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
     {
         // Push a buffer into the stream
-        pushStream->Write(buffer.data(), readSamples);
+        teeStream.Write(buffer.data(), readSamples);
     }
 
-    // Close the push stream.
-    pushStream->Close();
+    // Close the push stream and the archive.
+    try
+    {
+        teeStream.Close();
+    }
+    catch (const runtime_error& e)
+    {
+        cout << e.what() << std::endl;
+    }
 
     // Waits for recognition end.
     recognitionEnd.get_future().get();
@@ -483,9 +543,9 @@ void KeywordTriggeredSpeechRecognitionWithMicrophone()
         recognitionEnd.set_value(); // Notify to stop recognition.
     });
 
-    // Creates an instance of a keyword recognition model. Update this to
-    // point to the location of your keyword recognition model.
-    auto model = KeywordRecognitionModel::FromFile("YourKeywordRecognitionModelFile.table");
+    // Gets the keyword recognition model from the process-wide cache, which creates one model object per file and
+    // shares it between all recognizers. Update this to point to the location of your keyword recognition model.
+    auto model = KeywordModelCache::Instance().Get("YourKeywordRecognitionModelFile.table");
 
     // The phrase your keyword recognition model triggers on.
     auto keyword = "YourKeyword";
@@ -501,6 +561,11 @@ void KeywordTriggeredSpeechRecognitionWithMicrophone()
 
     // Stops recognition.
     recognizer->StopKeywordRecognitionAsync().get();
+
+    for (const auto& statistics : KeywordModelCache::Instance().GetStatistics())
+    {
+        cout << "Keyword model " << statistics.FileName << ": " << statistics.Requests << " request(s), loaded once" << std::endl;
+    }
 }
 
 // Speech recognition with auto detection for source language
@@ -679,6 +744,14 @@ void PronunciationAssessmentWithMicrophone()
             cout << "    Accuracy score: " << pronunciationResult->AccuracyScore << ", Pronunciation score: "
                  << pronunciationResult->PronunciationScore << ", Completeness score : " << pronunciationResult->CompletenessScore
                  << ", FluencyScore: " << pronunciationResult->FluencyScore << endl;
+
+            // Word level scores are only in the JSON result.
+            DetailedResultParser parser;
+            parser.Parse(result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult));
+            parser.GetAlternative(0).ForEachWord([](const DetailedWord& word)
+            {
+                cout << "    Word: " << word.Word() << ", Accuracy score: " << word.AccuracyScore() << ", Error type: " << word.ErrorType() << endl;
+            });
         }
         else if (result->Reason == ResultReason::NoMatch)
         {
@@ -698,3 +771,668 @@ void PronunciationAssessmentWithMicrophone()
         }
     }
 }
+
+// Speech recognition using pull stream input, recording a Chrome/Perfetto trace of the session.
+void SpeechContinuousRecognitionWithPullStreamAndTracing()
+{
+    // AudioInputFromFileCallback reads audio data from a wav file, and records a span for every Read() and Close()
+    // call on the track of the session it belongs to.
+    class AudioInputFromFileCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        AudioInputFromFileCallback(const string& audioFileName, uint32_t track)
+            : m_reader(audioFileName), m_track(track)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            TraceSpan span(m_track, "audio", "Read");
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            TraceSpan span(m_track, "audio", "Close");
+            m_reader.Close();
+        }
+
+    private:
+        WavFileReader m_reader;
+        uint32_t m_track;
+    };
+
+    // Starts recording. Open the trace file in chrome://tracing or https://ui.perfetto.dev after the session ends.
+    // Replace with your own trace file name.
+    auto traceFileName = "speech_trace.json";
+    auto& tracer = TraceRecorder::Instance();
+    tracer.Start(traceFileName);
+
+    // Every session gets its own track; it is renamed to the service session id once the session starts.
+    auto track = tracer.CreateTrack("whatstheweatherlike.wav");
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    shared_ptr<AudioInputFromFileCallback> callback;
+    shared_ptr<SpeechRecognizer> recognizer;
+    {
+        TraceSpan span(track, "sdk", "CreateRecognizer");
+        callback = make_shared<AudioInputFromFileCallback>("whatstheweatherlike.wav", track);
+        auto pullStream = AudioInputStream::CreatePullStream(callback);
+        recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullStream));
+    }
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    // Subscribes to events. Every handler records a span, so time spent in the application shows up next to the
+    // time spent waiting for the service.
+    recognizer->SessionStarted.Connect([track](const SessionEventArgs& e)
+    {
+        TraceSpan span(track, "handler", "SessionStarted");
+        TraceRecorder::Instance().SetTrackName(track, "session " + e.SessionId);
+    });
+
+    recognizer->Recognizing.Connect([track](const SpeechRecognitionEventArgs& e)
+    {
+        TraceSpan span(track, "handler", "Recognizing");
+        cout << "Recognizing:" << e.Result->Text << std::endl;
+    });
+
+    recognizer->Recognized.Connect([track](const SpeechRecognitionEventArgs& e)
+    {
+        TraceSpan span(track, "handler", "Recognized");
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl
+                 << "  Offset=" << e.Result->Offset() << std::endl
+                 << "  Duration=" << e.Result->Duration() << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+    });
+
+    recognizer->Canceled.Connect([track, &recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        TraceSpan span(track, "handler", "Canceled");
+        switch (e.Reason)
+        {
+        case CancellationReason::EndOfStream:
+            cout << "CANCELED: Reach the end of the file." << std::endl;
+            break;
+
+        case CancellationReason::Error:
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
+            cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
+            recognitionEnd.set_value();
+            break;
+
+        default:
+            cout << "CANCELED: received unknown reason." << std::endl;
+        }
+    });
+
+    recognizer->SessionStopped.Connect([track, &recognitionEnd](const SessionEventArgs& e)
+    {
+        TraceSpan span(track, "handler", "SessionStopped");
+        cout << "Session stopped.";
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    {
+        TraceSpan span(track, "sdk", "StartContinuousRecognitionAsync");
+        recognizer->StartContinuousRecognitionAsync().wait();
+    }
+
+    // Waits for recognition end.
+    {
+        TraceSpan span(track, "sdk", "WaitForSessionEnd");
+        recognitionEnd.get_future().wait();
+    }
+
+    // Stops recognition.
+    {
+        TraceSpan span(track, "sdk", "StopContinuousRecognitionAsync");
+        recognizer->StopContinuousRecognitionAsync().wait();
+    }
+
+    auto eventCount = tracer.Stop();
+    cout << "\nWrote " << eventCount << " trace events to " << traceFileName << std::endl;
+}
+
+// Checks an input file before recognizing it; prints any issues and returns false if it should be skipped.
+bool PreflightAudioFileForRecognition(const string& fileName)
+{
+    auto report = PreflightAudioFile(fileName);
+    for (const auto& issue : report.Issues)
+    {
+        cout << fileName << ": " << issue << std::endl;
+    }
+    if (report.Verdict == PreflightVerdict::Skip)
+    {
+        cout << fileName << ": skipped." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Continuous speech recognition with file input, indexing the transcript for phrase search with timestamps.
+void SpeechContinuousRecognitionWithTranscriptIndex()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The index would usually outlive a single recognition and hold many transcripts (e.g. a call archive).
+    TranscriptIndex index;
+
+    // Replace with your own audio file names.
+    for (const auto& fileName : { "whatstheweatherlike.wav" })
+    {
+        // Broken and silent files are skipped before a session is set up for them.
+        if (!PreflightAudioFileForRecognition(fileName))
+        {
+            continue;
+        }
+
+        auto audioInput = AudioConfig::FromWavFileInput(fileName);
+        auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+        // promise for synchronization of recognition end.
+        promise<void> recognitionEnd;
+
+        // Collects the words of the transcript with their offsets as results arrive.
+        TranscriptDocument document(fileName);
+        recognizer->Recognized.Connect([&document](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+                document.AddPhrase(e.Result->Text, e.Result->Offset(), e.Result->Duration());
+            }
+        });
+
+        recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+            if (e.Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                     << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                     << "CANCELED: Did you update the subscription info?" << std::endl;
+
+                recognitionEnd.set_value(); // Notify to stop recognition.
+            }
+        });
+
+        recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+        {
+            recognitionEnd.set_value(); // Notify to stop recognition.
+        });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognitionEnd.get_future().get();
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        index.AddDocument(document);
+    }
+
+    // Transcripts of batch transcription (the result files of kind "Transcription" of a v3 transcription job, see the
+    // from-blob quickstart) go into the same index. Replace with your own result files.
+    for (const auto& fileName : { "transcription.json" })
+    {
+        ifstream file(fileName, ios_base::binary);
+        if (!file.good())
+        {
+            continue;
+        }
+        string json((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        TranscriptDocument document(fileName);
+        document.AddBatchResult(json);
+        index.AddDocument(document);
+    }
+    cout << "Posting lists take " << index.GetPostingBytes() << " bytes." << std::endl;
+
+    string phrase;
+    do
+    {
+        cout << "\nPhrase to search for (empty to finish): ";
+        cout.flush();
+        phrase.clear();
+        getline(cin, phrase);
+
+        for (const auto& match : index.Search(phrase))
+        {
+            cout << "  " << index.GetDocumentName(match.Document) << " at " << match.OffsetMs / 1000.0 << " s (word " << match.Position << ")" << std::endl;
+        }
+    } while (!phrase.empty());
+}
+
+// Speech recognition of a multichannel microphone array recording, beamformed to mono on the client.
+// Unlike conversation transcription, this works with any array and sends a single channel to the service.
+void SpeechContinuousRecognitionWithBeamforming()
+{
+    // Pull audio input stream callback that reads a multichannel wav file and returns the beamformed mono audio.
+    class BeamformedAudioInputCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        BeamformedAudioInputCallback(const string& audioFileName, const MicrophoneArrayGeometry& geometry, double azimuthDegrees)
+            : m_reader(audioFileName, geometry, azimuthDegrees)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+        uint32_t GetSampleRate() const
+        {
+            return m_reader.GetSampleRate();
+        }
+
+    private:
+        BeamformingWavReader m_reader;
+    };
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Geometry of the array that recorded the file: here one microphone in the center and six on a circle of 4.25 cm
+    // radius on channels 0 to 6; channel 7 is a reference channel and is not used.
+    // Replace with the geometry of your array, and steer toward the talker (degrees counterclockwise from microphone 1).
+    auto geometry = MicrophoneArrayGeometry::Circular(6, 0.0425, true);
+    double azimuthDegrees = 0;
+
+    // The audio file may have any PCM or IEEE float sample format, with at least one channel per microphone.
+    shared_ptr<BeamformedAudioInputCallback> callback;
+    try
+    {
+        callback = make_shared<BeamformedAudioInputCallback>("katiesteve.wav", geometry, azimuthDegrees);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << endl;
+        return;
+    }
+
+    auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(callback->GetSampleRate(), 16, 1), callback);
+    auto audioInput = AudioConfig::FromStreamInput(pullStream);
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    // Subscribes to events.
+    recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+    });
+
+    recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+
+            recognitionEnd.set_value(); // Notify to stop recognition.
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        cout << "Session stopped.";
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Waits for recognition end.
+    recognitionEnd.get_future().get();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+}
+
+// Speech recognition of one long file as overlapping windows recognized in parallel, merged into one transcript.
+void SpeechRecognitionWithParallelWindows()
+{
+    // Pull audio input stream callback that reads one window of a wav file.
+    class WindowAudioInputCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        WindowAudioInputCallback(const string& audioFileName, const RecognitionWindow& window)
+            : m_reader(audioFileName, window)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+    private:
+        WindowWavFileReader m_reader;
+    };
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own (long) audio file name.
+    const string fileName = "whatstheweatherlike.wav";
+
+    if (!PreflightAudioFileForRecognition(fileName))
+    {
+        return;
+    }
+
+    // Windows of at least 5 minutes, up to 8 at once (stay within the concurrent request limit of your subscription),
+    // overlapping by 10 seconds so that a phrase cut at the edge of one window is complete in the next.
+    WavFileReader::WAVEFORMAT format;
+    uint64_t frameCount = 0;
+    {
+        Int16WavFileReader reader(fileName);
+        format = reader.GetFormat();
+        frameCount = reader.GetFrameCount();
+    }
+    const uint64_t minimumWindowFrames = 300ULL * format.SamplesPerSec;
+    const size_t windowCount = (size_t)max<uint64_t>(1, min<uint64_t>(8, frameCount / minimumWindowFrames));
+    auto windows = SplitIntoWindows(frameCount, windowCount, 10ULL * format.SamplesPerSec);
+    if (frameCount == 0)
+    {
+        // The header does not give the length (e.g. a file written while streaming): one window up to the end.
+        windows = { RecognitionWindow{ 0, UINT64_MAX } };
+    }
+    cout << "Recognizing " << frameCount / format.SamplesPerSec << " seconds of audio in " << windows.size() << " window(s)." << std::endl;
+
+    // One recognizer per window; all of them run at once.
+    vector<vector<TimedWord>> transcripts(windows.size());
+    vector<shared_ptr<SpeechRecognizer>> recognizers;
+    vector<promise<void>> recognitionEnds(windows.size());
+    for (size_t i = 0; i < windows.size(); i++)
+    {
+        auto callback = make_shared<WindowAudioInputCallback>(fileName, windows[i]);
+        auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(format.SamplesPerSec, 16, (unsigned char)format.Channels), callback);
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullStream));
+
+        // Offsets of results are relative to the start of the window.
+        auto windowOffset = windows[i].StartFrame * 10000000 / format.SamplesPerSec;
+        auto& transcript = transcripts[i];
+        recognizer->Recognized.Connect([&transcript, windowOffset](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                AppendPhraseWords(transcript, e.Result->Text, windowOffset + e.Result->Offset(), e.Result->Duration());
+            }
+        });
+
+        auto& recognitionEnd = recognitionEnds[i];
+        recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                     << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                     << "CANCELED: Did you update the subscription info?" << std::endl;
+
+                recognitionEnd.set_value(); // Notify to stop recognition.
+            }
+        });
+
+        recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+        {
+            recognitionEnd.set_value(); // Notify to stop recognition.
+        });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognizers.push_back(recognizer);
+    }
+
+    // Waits for all windows, then stops recognition.
+    for (size_t i = 0; i < windows.size(); i++)
+    {
+        recognitionEnds[i].get_future().get();
+        recognizers[i]->StopContinuousRecognitionAsync().get();
+        cout << "Window " << i + 1 << " done, " << transcripts[i].size() << " words." << std::endl;
+    }
+
+    auto merged = MergeWindowTranscripts(transcripts, windows, format.SamplesPerSec);
+    cout << "TRANSCRIPT:";
+    for (const auto& word : merged)
+    {
+        cout << " " << word.Text;
+    }
+    cout << std::endl;
+}
+
+// Speech recognition of a file streamed at real-time pace, with a breakdown of the latency of every utterance into
+// upload lag, service processing and delivery delay.
+void SpeechContinuousRecognitionWithLatencyBreakdown()
+{
+    // Reads a wav file no faster than it would be captured live, and records when the audio is handed to the SDK.
+    class RealTimeAudioInputCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        RealTimeAudioInputCallback(const string& audioFileName, ConnectionLatencyTracker& tracker)
+            : m_reader(audioFileName), m_tracker(tracker)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            if (m_bytesRead == 0)
+            {
+                m_start = chrono::steady_clock::now();
+            }
+            // At most 100 ms at a time, returned when it would have been captured.
+            auto read = m_reader.Read(dataBuffer, min(size, GetFormat().AvgBytesPerSec / 10 / GetFormat().BlockAlign * GetFormat().BlockAlign));
+            m_bytesRead += (uint64_t)max(read, 0);
+            this_thread::sleep_until(m_start + chrono::microseconds(m_bytesRead * 1000000 / GetFormat().AvgBytesPerSec));
+            m_tracker.OnAudioSent((size_t)max(read, 0));
+            return read;
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+        const WavFileReader::WAVEFORMAT& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
+    private:
+        Int16WavFileReader m_reader;
+        ConnectionLatencyTracker& m_tracker;
+        chrono::steady_clock::time_point m_start;
+        uint64_t m_bytesRead = 0;
+    };
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own audio file name.
+    const string fileName = "whatstheweatherlike.wav";
+    WavFileReader::WAVEFORMAT format = Int16WavFileReader(fileName).GetFormat();
+
+    // The tracker must outlive the recognizer.
+    ConnectionLatencyTracker tracker(format.AvgBytesPerSec);
+    auto callback = make_shared<RealTimeAudioInputCallback>(fileName, tracker);
+    auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(format.SamplesPerSec, 16, (unsigned char)format.Channels), callback);
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullStream));
+
+    // Subscribes to the service messages of the recognizer's connection.
+    tracker.Attach(recognizer);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    // Subscribes to events.
+    recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+        }
+    });
+
+    recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+
+            recognitionEnd.set_value(); // Notify to stop recognition.
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        cout << "Session stopped: " << e.SessionId << std::endl;
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Starts continuous recognition, waits for the end of the file, and stops recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+    recognitionEnd.get_future().get();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    cout << "LATENCY: turn.start " << tracker.GetTurnStartDelayMs() << " ms after the first audio, turn.end "
+         << tracker.GetTurnEndDelayMs() << " ms after the last audio." << std::endl;
+    for (const auto& utterance : tracker.GetUtterances())
+    {
+        cout << "  Utterance at " << utterance.Offset / 10000 << " ms (" << utterance.Hypotheses << " hypotheses): "
+             << utterance.TotalMs << " ms = upload lag " << utterance.UploadLagMs << " ms + service processing "
+             << utterance.ServiceProcessingMs << " ms + delivery delay " << utterance.DeliveryDelayMs << " ms" << std::endl;
+    }
+}
+
+// Speech continuous recognition of several files, one session each, with an SDK log per session that is summarized
+// on a background thread while the next session runs. A log is summarized once the SDK has stopped writing it.
+void SpeechContinuousRecognitionWithSdkLogAnalysis()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The logs of the last 3 sessions are kept, in speech-sdk-0.log to speech-sdk-2.log.
+    SdkLogRotation logRotation("speech-sdk", 3);
+    vector<pair<string, future<SdkLogSummary>>> summaries;
+
+    // The previous session, whose log is written until the next recognizer switches logging to another file.
+    string previousFileName, previousLogFileName;
+
+    // Replace with your own audio file names.
+    for (const string fileName : { "whatstheweatherlike.wav", "enrollment_audio_katie.wav" })
+    {
+        // Logging is switched to the session's file when the recognizer is created.
+        auto logFileName = logRotation.EnableForSession(config);
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(fileName));
+
+        // The log of the previous session is complete now, and is parsed on a thread of its own while this one runs.
+        if (!previousLogFileName.empty())
+        {
+            summaries.emplace_back(previousFileName, ParseSdkLogAsync(previousLogFileName));
+        }
+        previousFileName = fileName;
+        previousLogFileName = logFileName;
+
+        // promise for synchronization of recognition end.
+        promise<void> recognitionEnd;
+
+        recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+            }
+        });
+
+        recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                     << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                     << "CANCELED: Did you update the subscription info?" << std::endl;
+
+                recognitionEnd.set_value(); // Notify to stop recognition.
+            }
+        });
+
+        recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+        {
+            recognitionEnd.set_value(); // Notify to stop recognition.
+        });
+
+        // Starts continuous recognition, waits for the end of the file, and stops recognition.
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognitionEnd.get_future().get();
+        recognizer->StopContinuousRecognitionAsync().get();
+    }
+
+    // The last recognizer is gone, so its log is complete, too.
+    if (!previousLogFileName.empty())
+    {
+        summaries.emplace_back(previousFileName, ParseSdkLogAsync(previousLogFileName));
+    }
+
+    for (auto& summary : summaries)
+    {
+        try
+        {
+            auto log = summary.second.get();
+            cout << "SDK LOG of " << summary.first << ": " << log.Lines << " lines over " << log.DurationMs << " ms, "
+                 << log.ConnectionSetupMs.size() << " connection(s)";
+            for (auto setupMs : log.ConnectionSetupMs)
+            {
+                cout << " (" << setupMs << " ms to connect)";
+            }
+            cout << ", " << log.AudioPumpStalls << " audio pump stall(s) (longest " << log.LongestAudioPumpStallMs << " ms), "
+                 << log.Retries << " retries, " << log.Warnings << " warnings, " << log.Errors << " errors." << std::endl;
+            for (const auto& error : log.ErrorMessages)
+            {
+                cout << "  ERROR: " << error << std::endl;
+            }
+        }
+        catch (const exception& e)
+        {
+            cout << "SDK LOG of " << summary.first << ": " << e.what() << std::endl;
+        }
+    }
+}
@@ -7,6 +7,8 @@
 
 #include <speechapi_cxx.h>
 #include <fstream>
+#include "batched_file_writer.h"
+#include "output_readiness.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -765,3 +767,163 @@ void SpeechSynthesisWithSourceLanguageAutoDetection()
         }
     }
 }
+
+// Speech synthesis of many texts to wave files, one per text.
+// The texts are synthesized concurrently by a few synthesizers, and the files are written by a BatchedFileWriter as
+// the results come in, so synthesis does not wait for the disk and files finishing together are written in one batch.
+void SpeechSynthesisToFilesInBatch()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The audio data of a result in a riff format is a complete wave file.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Riff24Khz16BitMonoPcm);
+
+    // Receives the texts from console input first.
+    vector<string> texts;
+    while (true)
+    {
+        cout << "Enter some text that you want to synthesize, or enter empty text to start." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+        texts.push_back(text);
+    }
+
+    // Creates speech synthesizers with a null output stream; the audio is taken from the results. A synthesizer works
+    // on one text at a time, so the texts are spread over several of them.
+    vector<shared_ptr<SpeechSynthesizer>> synthesizers;
+    for (size_t i = 0; i < min<size_t>(texts.size(), 4); i++)
+    {
+        synthesizers.push_back(SpeechSynthesizer::FromConfig(config, nullptr));
+    }
+
+    // Starts all syntheses; each synthesizer queues its texts.
+    vector<future<shared_ptr<SpeechSynthesisResult>>> results;
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        results.push_back(synthesizers[i % synthesizers.size()]->SpeakTextAsync(texts[i]));
+    }
+
+    BatchedFileWriter writer;
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        auto result = results[i].get();
+
+        // Checks result.
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            // Instead of AudioDataStream::SaveToWavFile(), which writes on this thread, the audio goes to the writer.
+            auto fileName = "outputaudio-" + to_string(i + 1) + ".wav";
+            writer.WriteFile(fileName, result->GetAudioData(), [](const string& path, bool succeeded, const string& error)
+            {
+                if (!succeeded)
+                {
+                    cout << "Failed to write " << path << ": " << error << std::endl;
+                }
+            });
+            cout << "Speech synthesized for text [" << texts[i] << "], and the audio is being written to " << fileName << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+
+    // Waits for the files still being written.
+    writer.Flush();
+    auto statistics = writer.GetStatistics();
+    cout << statistics.Completed << " files written (" << statistics.Failed << " failed) using " << statistics.Backend
+        << "; maximum queue depth " << statistics.MaxQueueDepth << ", mean latency " << statistics.MeanLatencyMs
+        << " ms, p99 latency " << statistics.P99LatencyMs << " ms." << std::endl;
+}
+
+// Speech synthesis of several texts at once, with the audio of all of them read by one thread.
+// Each synthesizer writes to a ReadyAudioOutputStream, which signals when it has audio; an AudioOutputPoller waits
+// for any of them and drains the ready ones, so the number of threads does not grow with the number of streams.
+void SpeechSynthesisToManyOutputStreamsWithOnePoller()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    const vector<string> texts = { "Hello, world!", "How is the weather today?", "Streaming to many clients from one thread." };
+
+    AudioOutputPoller poller;
+    vector<shared_ptr<SpeechSynthesizer>> synthesizers;
+    vector<shared_ptr<ReadyAudioOutputStream>> streams;
+    vector<future<shared_ptr<SpeechSynthesisResult>>> results;
+    vector<size_t> audioSizes(texts.size());
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        // A synthesizer that gets 1 MB ahead of the reader waits for it.
+        auto stream = make_shared<ReadyAudioOutputStream>(1 << 20);
+        auto& audioSize = audioSizes[i];
+        poller.Add(stream, [&audioSize](const uint8_t* data, size_t size)
+        {
+            // Forward the audio to the client here, e.g. with a non-blocking socket write.
+            (void)data;
+            audioSize += size;
+        },
+        [i]()
+        {
+            cout << "Output stream " << i + 1 << " finished." << std::endl;
+        });
+
+        auto synthesizer = SpeechSynthesizer::FromConfig(config, AudioConfig::FromStreamOutput(AudioOutputStream::CreatePushStream(stream)));
+        results.push_back(synthesizer->SpeakTextAsync(texts[i]));
+        synthesizers.push_back(synthesizer);
+        streams.push_back(stream);
+    }
+
+    // Serves all streams until every one is finished. A synthesis has written all its audio once its result is ready,
+    // so its stream is closed then, whether or not the synthesizer closes it; the poller reads what is left and
+    // removes the stream.
+    vector<bool> ended(texts.size());
+    while (poller.Poll(100) > 0)
+    {
+        for (size_t i = 0; i < texts.size(); i++)
+        {
+            if (!ended[i] && results[i].wait_for(chrono::seconds(0)) == future_status::ready)
+            {
+                streams[i]->Close();
+                ended[i] = true;
+            }
+        }
+    }
+    synthesizers.clear();
+
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        auto result = results[i].get();
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            cout << "Speech synthesized for text [" << texts[i] << "], " << audioSizes[i] << " bytes read from its output stream." << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+}
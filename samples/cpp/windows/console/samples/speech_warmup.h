@@ -0,0 +1,242 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "keyword_model_cache.h"
+
+// Timing of one warm-up step.
+struct SpeechWarmupStepTiming
+{
+    std::string Name;
+    double Milliseconds = 0;
+    bool Succeeded = false;
+    std::string Error;
+};
+
+// A recognizer whose service connection has been opened by the warm-up, and the push stream that feeds it.
+struct SpeechWarmupRecognizer
+{
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> Recognizer;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> AudioStream;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection> Connection;
+};
+
+// Pays the one-time costs of the first recognition eagerly, at process start, so that the first real request is fast:
+// loading and initializing the Speech SDK core, loading the compressed input codec, loading keyword models (into the
+// KeywordModelCache) and opening a connection to the service, which is kept for the first request. The steps run in
+// parallel; their timings are available once the warm-up is ready. A readiness file can be written when all steps have
+// finished, to back an orchestrator readiness probe (e.g. a Kubernetes exec probe running "test -f <file>").
+class SpeechWarmup final
+{
+public:
+    explicit SpeechWarmup(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config)
+        : m_config(config)
+    {
+    }
+
+    ~SpeechWarmup()
+    {
+        for (auto& step : m_running)
+        {
+            if (step.valid())
+            {
+                step.wait();
+            }
+        }
+    }
+
+    SpeechWarmup(const SpeechWarmup&) = delete;
+    SpeechWarmup& operator=(const SpeechWarmup&) = delete;
+
+    // Creates a recognizer on a compressed (MP3) input stream, which loads the SDK's GStreamer based codec module.
+    // Whether GStreamer itself (and its plugin registry) is initialized then or only when the first compressed audio
+    // arrives depends on the SDK version; measure the first compressed recognition to know what this step saves.
+    SpeechWarmup& AddCompressedInput()
+    {
+        m_compressedInput = true;
+        return *this;
+    }
+
+    // Loads a keyword recognition model into KeywordModelCache::Instance(); get it from there or with
+    // GetKeywordModel() once ready.
+    SpeechWarmup& AddKeywordModel(const std::string& fileName)
+    {
+        m_keywordModelFileName = fileName;
+        return *this;
+    }
+
+    // Creates a recognizer on a push stream of 'format' (default: 16 kHz 16-bit mono PCM) and opens its connection to
+    // the service, which resolves the host and sets up TLS and authentication. Take the recognizer with
+    // TakeRecognizer() for the first request; the service closes connections that stay idle for long.
+    SpeechWarmup& AddConnection(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> format = nullptr)
+    {
+        m_connection = true;
+        m_connectionFormat = format;
+        return *this;
+    }
+
+    // Writes 'fileName' when the warm-up is ready.
+    SpeechWarmup& SetReadinessFile(const std::string& fileName)
+    {
+        m_readinessFileName = fileName;
+        return *this;
+    }
+
+    // Starts all steps in parallel and returns immediately.
+    void Start()
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        if (m_started.exchange(true))
+        {
+            throw std::logic_error("The warm-up has already been started.");
+        }
+
+        auto config = m_config;
+        m_pending = 1 + (m_compressedInput ? 1 : 0) + (m_keywordModelFileName.empty() ? 0 : 1) + (m_connection ? 1 : 0);
+
+        RunStep("sdk", [config]()
+        {
+            SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(AudioInputStream::CreatePushStream()));
+        });
+
+        if (m_compressedInput)
+        {
+            RunStep("gstreamer", [config]()
+            {
+                auto format = AudioStreamFormat::GetCompressedFormat(AudioStreamContainerFormat::MP3);
+                SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(AudioInputStream::CreatePushStream(format)));
+            });
+        }
+
+        if (!m_keywordModelFileName.empty())
+        {
+            auto fileName = m_keywordModelFileName;
+            RunStep("keyword-model", [this, fileName]()
+            {
+                auto model = KeywordModelCache::Instance().Get(fileName);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_keywordModel = model;
+            });
+        }
+
+        if (m_connection)
+        {
+            auto format = m_connectionFormat;
+            RunStep("connection", [this, config, format]()
+            {
+                auto stream = format ? AudioInputStream::CreatePushStream(format) : AudioInputStream::CreatePushStream();
+                auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(stream));
+                auto connection = Connection::FromRecognizer(recognizer);
+                connection->Open(true);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_recognizer = SpeechWarmupRecognizer{ recognizer, stream, connection };
+            });
+        }
+    }
+
+    // True once Start() has been called and all steps have finished.
+    bool IsReady() const
+    {
+        return m_started.load() && m_pending.load() == 0;
+    }
+
+    // Blocks until all steps have finished (successfully or not). Start() must have been called.
+    void WaitUntilReady()
+    {
+        if (!m_started.load())
+        {
+            throw std::logic_error("The warm-up has not been started.");
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this]() { return IsReady(); });
+    }
+
+    // Gets the timings of the finished steps, in the order they finished.
+    std::vector<SpeechWarmupStepTiming> GetTimings() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_timings;
+    }
+
+    // Gets the keyword model loaded by the warm-up, or nullptr.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> GetKeywordModel() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_keywordModel;
+    }
+
+    // Hands over the recognizer opened by the connection step, once; empty if the step was not added, has not
+    // finished or failed. Write the audio to its AudioStream and close the stream at the end of the audio.
+    SpeechWarmupRecognizer TakeRecognizer()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        SpeechWarmupRecognizer recognizer;
+        std::swap(recognizer, m_recognizer);
+        return recognizer;
+    }
+
+private:
+    template <class Step>
+    void RunStep(const char* name, Step step)
+    {
+        m_running.push_back(std::async(std::launch::async, [this, name, step]()
+        {
+            SpeechWarmupStepTiming timing;
+            timing.Name = name;
+            auto start = std::chrono::steady_clock::now();
+            try
+            {
+                step();
+                timing.Succeeded = true;
+            }
+            catch (const std::exception& e)
+            {
+                timing.Error = e.what();
+            }
+            timing.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_timings.push_back(timing);
+            if (--m_pending == 0)
+            {
+                if (!m_readinessFileName.empty())
+                {
+                    std::ofstream(m_readinessFileName) << "ready\n";
+                }
+                m_ready.notify_all();
+            }
+        }));
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    bool m_compressedInput = false;
+    bool m_connection = false;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> m_connectionFormat;
+    std::string m_keywordModelFileName;
+    std::string m_readinessFileName;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::atomic<bool> m_started{ false };
+    std::atomic<int> m_pending{ 0 };
+    std::vector<SpeechWarmupStepTiming> m_timings;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> m_keywordModel;
+    SpeechWarmupRecognizer m_recognizer;
+    std::vector<std::future<void>> m_running;
+};
@@ -0,0 +1,176 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Startup benchmark: time from process exec to the first recognized result, with and without the warm-up routine.
+// Run it once per measurement, so that every run pays the full cold-start cost:
+//
+//   startup_benchmark [--warmup] [--key <key> --region <region> | --host <ws://...>]
+//                     [--file whatstheweatherlike.wav] [--keyword-model <file.table>] [--readiness-file <file>]
+//
+// Without --key/--region or --host, a local mock service is started in a child process.
+//
+
+#include "stdafx.h"
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <signal.h>
+#include <sys/wait.h>
+#include "mock_speech_service.h"
+#include "speech_warmup.h"
+#include "wav_file_reader.h"
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+namespace
+{
+    // Milliseconds since the kernel started this process, from /proc (10 ms resolution).
+    double MillisecondsSinceExec()
+    {
+        ifstream statFile("/proc/self/stat");
+        string stat;
+        getline(statFile, stat);
+
+        // The fields after the parenthesized command name; starttime is field 22 of the line, i.e. the 20th here.
+        istringstream fields(stat.substr(stat.rfind(')') + 2));
+        string field;
+        for (int i = 0; i < 20; i++)
+        {
+            fields >> field;
+        }
+        auto startTicks = stod(field);
+
+        double uptimeSeconds = 0;
+        ifstream("/proc/uptime") >> uptimeSeconds;
+        return (uptimeSeconds - startTicks / sysconf(_SC_CLK_TCK)) * 1000.0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto atMain = MillisecondsSinceExec();
+    auto mainStart = chrono::steady_clock::now();
+    auto sinceExec = [atMain, mainStart]()
+    {
+        return atMain + chrono::duration<double, milli>(chrono::steady_clock::now() - mainStart).count();
+    };
+
+    bool warmup = false;
+    string key, region, host, keywordModel, readinessFile;
+    string fileName = "whatstheweatherlike.wav";
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--warmup") warmup = true;
+        else if (i + 1 >= argc) break;
+        else if (arg == "--key") key = argv[++i];
+        else if (arg == "--region") region = argv[++i];
+        else if (arg == "--host") host = argv[++i];
+        else if (arg == "--file") fileName = argv[++i];
+        else if (arg == "--keyword-model") keywordModel = argv[++i];
+        else if (arg == "--readiness-file") readinessFile = argv[++i];
+    }
+
+    pid_t mockPid = 0;
+    try
+    {
+        if (key.empty() && host.empty())
+        {
+            mockPid = MockSpeechService::StartInChildProcess(&host, 1.0);
+        }
+
+        cout << "main() reached:                 " << atMain << " ms after exec" << endl;
+
+        auto config = key.empty() ? SpeechConfig::FromHost(host) : SpeechConfig::FromSubscription(key, region);
+
+        // With the warm-up, the recognizer whose connection it opened is used, fed from the file through its push stream.
+        shared_ptr<SpeechRecognizer> recognizer;
+        shared_ptr<PushAudioInputStream> warmStream;
+        if (warmup)
+        {
+            WavFileReader reader(fileName);
+            auto format = reader.GetFormat();
+            SpeechWarmup warmer(config);
+            warmer.AddConnection(AudioStreamFormat::GetWaveFormatPCM(format.SamplesPerSec, (uint8_t)format.BitsPerSample, (uint8_t)format.Channels));
+            if (!keywordModel.empty())
+            {
+                warmer.AddKeywordModel(keywordModel);
+            }
+            if (!readinessFile.empty())
+            {
+                warmer.SetReadinessFile(readinessFile);
+            }
+            warmer.Start();
+            warmer.WaitUntilReady();
+
+            for (const auto& step : warmer.GetTimings())
+            {
+                cout << "  warm-up step " << step.Name << ": " << step.Milliseconds << " ms"
+                     << (step.Succeeded ? "" : " (failed: " + step.Error + ")") << endl;
+            }
+            cout << "Warm-up ready:                  " << sinceExec() << " ms after exec" << endl;
+
+            auto warm = warmer.TakeRecognizer();
+            recognizer = warm.Recognizer;
+            warmStream = warm.AudioStream;
+        }
+        if (!recognizer)
+        {
+            recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(fileName));
+        }
+
+        promise<double> firstResult;
+        atomic<bool> firstResultSet{ false };
+        recognizer->Recognized.Connect([&](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech && !firstResultSet.exchange(true))
+            {
+                firstResult.set_value(sinceExec());
+            }
+        });
+        recognizer->Canceled.Connect([&](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (!firstResultSet.exchange(true))
+            {
+                firstResult.set_exception(make_exception_ptr(runtime_error("Recognition canceled: " + e.ErrorDetails)));
+            }
+        });
+
+        auto recognitionStart = sinceExec();
+        recognizer->StartContinuousRecognitionAsync().get();
+        if (warmStream)
+        {
+            // The push stream buffers what is written, so the whole file is handed over at once, like the file input does.
+            WavFileReader reader(fileName);
+            vector<uint8_t> buffer(3200);
+            int read = 0;
+            while ((read = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
+            {
+                warmStream->Write(buffer.data(), (uint32_t)read);
+            }
+            warmStream->Close();
+        }
+        auto firstResultTime = firstResult.get_future().get();
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        cout << "Recognition started:            " << recognitionStart << " ms after exec" << endl;
+        cout << "First recognized result:        " << firstResultTime << " ms after exec" << endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << endl;
+    }
+
+    if (mockPid > 0)
+    {
+        kill(mockPid, SIGTERM);
+        waitpid(mockPid, nullptr, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Collects spans in the Chrome trace-event JSON format, which can be opened in chrome://tracing or https://ui.perfetto.dev.
+// Every session gets its own track (shown as a process in the viewers), and every thread that touches the session gets
+// a row inside that track, so spans from the audio callback, the SDK async calls and the event handlers nest correctly.
+// When the recorder is not started, a span costs a single relaxed atomic load.
+//
+// Each thread appends to a buffer of its own, guarded by a lock only Start() and Stop() contend for, so concurrent
+// sessions do not serialize on the recorder.
+class TraceRecorder final
+{
+public:
+    // Returns the process-wide recorder.
+    static TraceRecorder& Instance()
+    {
+        static TraceRecorder instance;
+        return instance;
+    }
+
+    // Starts recording. The events are written to 'traceFileName' when Stop() is called.
+    void Start(const std::string& traceFileName)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fileName = traceFileName;
+        m_metadata.clear();
+        for (auto& buffer : m_buffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->Mutex);
+            buffer->Events.clear();
+        }
+        RemoveExitedThreads();
+        m_nextTrack = 1;
+        m_originTicks.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        m_enabled.store(true, std::memory_order_release);
+    }
+
+    // Stops recording and writes the collected events. Returns the number of events written.
+    size_t Stop()
+    {
+        m_enabled.store(false, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ofstream out(m_fileName, std::ios_base::out | std::ios_base::trunc);
+        if (!out.good())
+        {
+            throw std::runtime_error("Failed to open the trace file for writing.");
+        }
+
+        size_t count = 0;
+        auto write = [&out, &count](const std::string& event)
+        {
+            out << (count++ == 0 ? "" : ",\n") << event;
+        };
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (const auto& event : m_metadata)
+        {
+            write(event);
+        }
+        for (auto& buffer : m_buffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->Mutex);
+            for (const auto& event : buffer->Events)
+            {
+                write(event);
+            }
+            buffer->Events.clear();
+        }
+        out << "\n]}\n";
+
+        m_metadata.clear();
+        RemoveExitedThreads();
+        return count;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Allocates a new track. Returns 0 (no track) when the recorder is not started.
+    uint32_t CreateTrack(const std::string& name)
+    {
+        if (!IsEnabled())
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto track = m_nextTrack++;
+        m_metadata.push_back(MetadataEvent("process_name", track, name));
+        return track;
+    }
+
+    // Renames a track, e.g. once the service session id is known.
+    void SetTrackName(uint32_t track, const std::string& name)
+    {
+        if (!IsEnabled() || track == 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_metadata.push_back(MetadataEvent("process_name", track, name));
+    }
+
+    // Records a complete ("X") event on the calling thread's row of the track.
+    void AddSpan(uint32_t track, const char* category, const char* name, int64_t startUs, int64_t durationUs)
+    {
+        auto& buffer = CurrentThreadBuffer();
+        std::string event;
+        event.reserve(128);
+        event += "{\"ph\":\"X\",\"cat\":\"";
+        event += category;
+        event += "\",\"name\":\"";
+        event += name;
+        event += "\",\"pid\":";
+        event += std::to_string(track);
+        event += ",\"tid\":";
+        event += std::to_string(buffer.Row);
+        event += ",\"ts\":";
+        event += std::to_string(startUs);
+        event += ",\"dur\":";
+        event += std::to_string(durationUs);
+        event += "}";
+
+        std::lock_guard<std::mutex> lock(buffer.Mutex);
+        buffer.Events.push_back(std::move(event));
+    }
+
+    // Records an instant ("i") event, e.g. for the arrival of a result.
+    void AddInstant(uint32_t track, const char* category, const char* name)
+    {
+        if (!IsEnabled() || track == 0)
+        {
+            return;
+        }
+
+        auto& buffer = CurrentThreadBuffer();
+        std::string event;
+        event.reserve(128);
+        event += "{\"ph\":\"i\",\"s\":\"p\",\"cat\":\"";
+        event += category;
+        event += "\",\"name\":\"";
+        event += name;
+        event += "\",\"pid\":";
+        event += std::to_string(track);
+        event += ",\"tid\":";
+        event += std::to_string(buffer.Row);
+        event += ",\"ts\":";
+        event += std::to_string(NowUs());
+        event += "}";
+
+        std::lock_guard<std::mutex> lock(buffer.Mutex);
+        buffer.Events.push_back(std::move(event));
+    }
+
+    // Microseconds since Start().
+    int64_t NowUs() const
+    {
+        std::chrono::steady_clock::time_point origin(std::chrono::steady_clock::duration(m_originTicks.load(std::memory_order_relaxed)));
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+private:
+    // The events of one thread. It outlives the thread, so that events recorded by a thread that has ended are still
+    // written by Stop().
+    struct ThreadBuffer
+    {
+        std::mutex Mutex;
+        std::vector<std::string> Events;
+        uint32_t Row = 0;               // Row ids are handed out in order, so they never collide.
+        bool ThreadExited = false;
+    };
+
+    TraceRecorder() = default;
+
+    static std::string MetadataEvent(const char* kind, uint32_t track, const std::string& value)
+    {
+        std::string escaped;
+        for (auto c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return std::string("{\"ph\":\"M\",\"name\":\"") + kind + "\",\"pid\":" + std::to_string(track) +
+            ",\"args\":{\"name\":\"" + escaped + "\"}}";
+    }
+
+    ThreadBuffer& CurrentThreadBuffer()
+    {
+        // Registered on the thread's first event; marked as exited when the thread ends.
+        struct Registration
+        {
+            std::shared_ptr<ThreadBuffer> Buffer;
+
+            ~Registration()
+            {
+                std::lock_guard<std::mutex> lock(Buffer->Mutex);
+                Buffer->ThreadExited = true;
+            }
+        };
+        static thread_local Registration registration{ Register() };
+        return *registration.Buffer;
+    }
+
+    std::shared_ptr<ThreadBuffer> Register()
+    {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer->Row = m_nextRow++;
+        m_buffers.push_back(buffer);
+        return buffer;
+    }
+
+    // Called with m_mutex held, once the buffers have been written or cleared.
+    void RemoveExitedThreads()
+    {
+        m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [](const std::shared_ptr<ThreadBuffer>& buffer)
+        {
+            std::lock_guard<std::mutex> lock(buffer->Mutex);
+            return buffer->ThreadExited;
+        }), m_buffers.end());
+    }
+
+    std::atomic<bool> m_enabled{ false };
+    std::mutex m_mutex;
+    std::string m_fileName;
+    std::vector<std::string> m_metadata;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    uint32_t m_nextTrack = 1;
+    uint32_t m_nextRow = 1;
+    std::atomic<std::chrono::steady_clock::rep> m_originTicks{ std::chrono::steady_clock::now().time_since_epoch().count() };
+};
+
+// Records the lifetime of a scope as a span on the given track. Does nothing when the recorder is not started.
+// 'category' and 'name' must be string literals (or otherwise outlive the span) and must not need JSON escaping.
+class TraceSpan final
+{
+public:
+    TraceSpan(uint32_t track, const char* category, const char* name)
+        : m_track(track), m_category(category), m_name(name)
+    {
+        if (m_track != 0 && TraceRecorder::Instance().IsEnabled())
+        {
+            m_startUs = TraceRecorder::Instance().NowUs();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_startUs >= 0 && TraceRecorder::Instance().IsEnabled())
+        {
+            auto& recorder = TraceRecorder::Instance();
+            recorder.AddSpan(m_track, m_category, m_name, m_startUs, recorder.NowUs() - m_startUs);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    uint32_t m_track;
+    const char* m_category;
+    const char* m_name;
+    int64_t m_startUs = -1;
+};
@@ -0,0 +1,424 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "detailed_result_json.h"
+
+// The words of one transcript with their audio offsets, collected while it is being recognized.
+class TranscriptDocument final
+{
+public:
+    explicit TranscriptDocument(const std::string& name) : m_name(name)
+    {
+    }
+
+    // Adds a recognized phrase (e.g. a Recognized result's Text, Offset() and Duration(), in ticks of 100 ns).
+    // Word offsets are interpolated over the phrase duration by character position.
+    void AddPhrase(const std::string& text, uint64_t offset, uint64_t duration)
+    {
+        auto words = Tokenize(text);
+        for (const auto& word : words)
+        {
+            auto wordOffset = offset + (text.empty() ? 0 : duration * word.second / text.size());
+            AddWord(word.first, wordOffset);
+        }
+    }
+
+    // Adds a word with its own offset (e.g. from word-level timestamps of detailed results), in ticks of 100 ns.
+    void AddWord(const std::string& word, uint64_t offset)
+    {
+        m_words.push_back(word);
+        m_offsetsMs.push_back((uint32_t)(offset / 10000));
+    }
+
+    // Adds the recognized phrases of a speech-to-text v3 batch transcription result (the JSON of a file of kind
+    // "Transcription"), in order of offset. With 'channel' >= 0, only the phrases of that channel are added. The words
+    // of the best recognition carry their own offsets if the transcription was created with word level timestamps;
+    // otherwise the offsets are interpolated over the phrase.
+    void AddBatchResult(const std::string& json, int channel = -1)
+    {
+        struct Phrase
+        {
+            uint64_t Offset;
+            uint64_t Duration;
+            JsonValue Best;
+        };
+        std::vector<Phrase> phrases;
+        JsonValue root(json.data(), json.data() + json.size());
+        root["recognizedPhrases"].ForEachElement([&phrases, channel](JsonValue phrase)
+        {
+            if ((channel < 0 || (int)phrase["channel"].AsUInt64() == channel) && phrase["recognitionStatus"].AsString() == "Success")
+            {
+                auto best = phrase["nBest"][(size_t)0];
+                if (best.Exists())
+                {
+                    phrases.push_back(Phrase{ phrase["offsetInTicks"].AsUInt64(), phrase["durationInTicks"].AsUInt64(), best });
+                }
+            }
+            return true;
+        });
+        std::stable_sort(phrases.begin(), phrases.end(), [](const Phrase& a, const Phrase& b) { return a.Offset < b.Offset; });
+
+        for (const auto& phrase : phrases)
+        {
+            auto words = phrase.Best["words"];
+            if (words.IsArray() && words.Size() > 0)
+            {
+                words.ForEachElement([this](JsonValue word)
+                {
+                    auto offset = word["offsetInTicks"].AsUInt64();
+                    for (const auto& token : Tokenize(word["word"].AsString()))
+                    {
+                        AddWord(token.first, offset);
+                    }
+                    return true;
+                });
+            }
+            else
+            {
+                AddPhrase(phrase.Best["display"].AsString(), phrase.Offset, phrase.Duration);
+            }
+        }
+    }
+
+    const std::string& GetName() const { return m_name; }
+
+    // Splits text into lowercase words; returns each word with its character position in the text.
+    // Letters, digits, bytes of multi-byte UTF-8 characters and apostrophes inside words are word characters.
+    static std::vector<std::pair<std::string, size_t>> Tokenize(const std::string& text)
+    {
+        std::vector<std::pair<std::string, size_t>> words;
+        std::string word;
+        size_t start = 0;
+        for (size_t i = 0; i <= text.size(); i++)
+        {
+            auto c = i < text.size() ? (unsigned char)text[i] : ' ';
+            auto isWordCharacter = isalnum(c) || c >= 0x80 || (c == '\'' && !word.empty() && i + 1 < text.size() && isalnum((unsigned char)text[i + 1]));
+            if (isWordCharacter)
+            {
+                if (word.empty())
+                {
+                    start = i;
+                }
+                word.push_back((char)tolower(c));
+            }
+            else if (!word.empty())
+            {
+                words.emplace_back(word, start);
+                word.clear();
+            }
+        }
+        return words;
+    }
+
+private:
+    friend class TranscriptIndex;
+
+    std::string m_name;
+    std::vector<std::string> m_words;
+    std::vector<uint32_t> m_offsetsMs;
+};
+
+// A phrase match: the document, the position of the first word in it and its audio offset.
+struct TranscriptMatch
+{
+    uint32_t Document;
+    uint32_t Position;
+    uint32_t OffsetMs;
+};
+
+// Inverted index over transcripts with positional postings that carry audio offsets, for phrase search.
+//
+// Every term has one posting list: a byte string of (document delta, position, offset) triples in varint coding,
+// ordered by document and position. Within a document, position and offset are deltas to the previous posting;
+// in a new document they are absolute. Documents are added whole, so lists are only ever appended to.
+//
+// Every 64th document of a list also gets a skip entry (document, byte offset), where decoding can start. A phrase
+// search decodes the list of its rarest term and seeks the other lists to each candidate document through the skips,
+// so it costs O(c (log s + 64 + p)) per further term for c candidates, s skips and p postings of the term within a
+// candidate document, rather than the length of every list.
+class TranscriptIndex final
+{
+public:
+    // Adds a finished transcript and returns its document number. Thread-safe.
+    uint32_t AddDocument(const TranscriptDocument& document)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto id = (uint32_t)m_documentNames.size();
+        m_documentNames.push_back(document.m_name);
+
+        for (uint32_t position = 0; position < document.m_words.size(); position++)
+        {
+            auto& list = m_postings[document.m_words[position]];
+            auto offsetMs = document.m_offsetsMs[position];
+            if (list.Bytes.empty() || list.LastDocument != id)
+            {
+                if (list.Documents++ % skipInterval == 0)
+                {
+                    list.Skips.push_back(Skip{ id, list.Bytes.size() });
+                }
+                WriteVarint(list.Bytes, list.Bytes.empty() ? id : id - list.LastDocument);
+                WriteVarint(list.Bytes, position);
+                WriteVarint(list.Bytes, offsetMs);
+            }
+            else
+            {
+                WriteVarint(list.Bytes, 0);
+                WriteVarint(list.Bytes, position - list.LastPosition);
+                // Offsets are monotonic unless interpolation overlapped; clamp to keep the delta unsigned.
+                offsetMs = std::max(offsetMs, list.LastOffsetMs);
+                WriteVarint(list.Bytes, offsetMs - list.LastOffsetMs);
+            }
+            list.LastDocument = id;
+            list.LastPosition = position;
+            list.LastOffsetMs = offsetMs;
+            list.Count++;
+        }
+        return id;
+    }
+
+    // Finds all occurrences of the phrase (one or more words, tokenized like the transcripts). Thread-safe.
+    std::vector<TranscriptMatch> Search(const std::string& phrase) const
+    {
+        auto words = TranscriptDocument::Tokenize(phrase);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::vector<std::pair<const PostingList*, uint32_t>> terms;
+        for (uint32_t i = 0; i < words.size(); i++)
+        {
+            auto list = m_postings.find(words[i].first);
+            if (list == m_postings.end())
+            {
+                return std::vector<TranscriptMatch>();
+            }
+            terms.emplace_back(&list->second, i);
+        }
+        if (terms.empty())
+        {
+            return std::vector<TranscriptMatch>();
+        }
+
+        // Starts from the rarest term and narrows the candidates down with the others, whose lists are only decoded
+        // around the candidates.
+        std::sort(terms.begin(), terms.end(), [](const std::pair<const PostingList*, uint32_t>& a, const std::pair<const PostingList*, uint32_t>& b)
+        {
+            return a.first->Count < b.first->Count;
+        });
+
+        // Candidates are phrase starts: (document, position of the term - its index in the phrase).
+        std::vector<TranscriptMatch> candidates;
+        Decode(*terms[0].first, [&candidates, &terms](uint32_t document, uint32_t position, uint32_t offsetMs)
+        {
+            if (position >= terms[0].second)
+            {
+                candidates.push_back({ document, position - terms[0].second, offsetMs });
+            }
+        });
+
+        for (size_t t = 1; t < terms.size() && !candidates.empty(); t++)
+        {
+            auto phraseIndex = terms[t].second;
+            std::vector<TranscriptMatch> remaining;
+            PostingCursor cursor(*terms[t].first);
+            for (const auto& candidate : candidates)
+            {
+                if (cursor.Seek(candidate.Document, candidate.Position + phraseIndex) &&
+                    cursor.Document == candidate.Document && cursor.Position == candidate.Position + phraseIndex)
+                {
+                    remaining.push_back(candidate);
+                }
+            }
+            candidates.swap(remaining);
+        }
+
+        // The offset of a match is that of the phrase's first word.
+        if (terms[0].second != 0)
+        {
+            PostingCursor cursor(m_postings.find(words[0].first)->second);
+            for (auto& candidate : candidates)
+            {
+                if (cursor.Seek(candidate.Document, candidate.Position))
+                {
+                    candidate.OffsetMs = cursor.OffsetMs;
+                }
+            }
+        }
+        return candidates;
+    }
+
+    std::string GetDocumentName(uint32_t document) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_documentNames.at(document);
+    }
+
+    // Size of the compressed posting lists, in bytes.
+    size_t GetPostingBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = 0;
+        for (const auto& list : m_postings)
+        {
+            bytes += list.second.Bytes.size() + list.second.Skips.size() * sizeof(Skip);
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr uint32_t skipInterval = 64;
+
+    // Where the postings of a document start; decoding can begin there.
+    struct Skip
+    {
+        uint32_t Document;
+        size_t ByteOffset;
+    };
+
+    struct PostingList
+    {
+        std::string Bytes;
+        std::vector<Skip> Skips;
+        uint32_t Count = 0;
+        uint32_t Documents = 0;
+        uint32_t LastDocument = 0;
+        uint32_t LastPosition = 0;
+        uint32_t LastOffsetMs = 0;
+    };
+
+    static void WriteVarint(std::string& bytes, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back((char)value);
+    }
+
+    static uint32_t ReadVarint(const unsigned char*& data)
+    {
+        uint32_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            auto byte = *data++;
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if (byte < 0x80)
+            {
+                return value;
+            }
+        }
+    }
+
+    // Calls 'posting(document, position, offsetMs)' for every posting of the list, in order.
+    template <class Posting>
+    static void Decode(const PostingList& list, Posting posting)
+    {
+        auto data = (const unsigned char*)list.Bytes.data();
+        auto end = data + list.Bytes.size();
+        uint32_t document = 0, position = 0, offsetMs = 0;
+        bool first = true;
+        while (data < end)
+        {
+            auto documentDelta = ReadVarint(data);
+            auto positionValue = ReadVarint(data);
+            auto offsetValue = ReadVarint(data);
+            if (first || documentDelta != 0)
+            {
+                document += documentDelta;
+                position = positionValue;
+                offsetMs = offsetValue;
+                first = false;
+            }
+            else
+            {
+                position += positionValue;
+                offsetMs += offsetValue;
+            }
+            posting(document, position, offsetMs);
+        }
+    }
+
+    // Walks a posting list forward, jumping ahead through its skips.
+    class PostingCursor
+    {
+    public:
+        explicit PostingCursor(const PostingList& list)
+            : m_list(list), m_data((const unsigned char*)list.Bytes.data()), m_end(m_data + list.Bytes.size())
+        {
+            Next();
+        }
+
+        // Moves to the first posting at or after ('document', 'position'); returns false if there is none.
+        bool Seek(uint32_t document, uint32_t position)
+        {
+            if (m_valid && Document < document)
+            {
+                // The last skip at or before the document, if it is ahead of the cursor.
+                auto skip = std::upper_bound(m_list.Skips.begin(), m_list.Skips.end(), document,
+                    [](uint32_t target, const Skip& s) { return target < s.Document; });
+                if (skip != m_list.Skips.begin() && (--skip)->Document > Document)
+                {
+                    m_data = (const unsigned char*)m_list.Bytes.data() + skip->ByteOffset;
+                    Document = skip->Document;
+                    m_jumped = true;
+                    Next();
+                }
+            }
+            while (m_valid && (Document < document || (Document == document && Position < position)))
+            {
+                Next();
+            }
+            return m_valid;
+        }
+
+        uint32_t Document = 0;
+        uint32_t Position = 0;
+        uint32_t OffsetMs = 0;
+
+    private:
+        void Next()
+        {
+            m_valid = m_data < m_end;
+            if (!m_valid)
+            {
+                return;
+            }
+            auto documentDelta = ReadVarint(m_data);
+            auto positionValue = ReadVarint(m_data);
+            auto offsetValue = ReadVarint(m_data);
+            if (m_first || m_jumped || documentDelta != 0)
+            {
+                // After a jump, Document already holds the skip's document.
+                Document = m_jumped ? Document : Document + documentDelta;
+                Position = positionValue;
+                OffsetMs = offsetValue;
+                m_first = m_jumped = false;
+            }
+            else
+            {
+                Position += positionValue;
+                OffsetMs += offsetValue;
+            }
+        }
+
+        const PostingList& m_list;
+        const unsigned char* m_data;
+        const unsigned char* m_end;
+        bool m_valid = false;
+        bool m_first = true;
+        bool m_jumped = false;
+    };
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, PostingList> m_postings;
+    std::vector<std::string> m_documentNames;
+};
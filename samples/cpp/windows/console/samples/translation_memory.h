@@ -0,0 +1,280 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Caches translations of recognized sentences, keyed by (normalized source text, source language, target language),
+// so that repeated stock phrases can be answered from the cache and downstream processing (further machine translation,
+// synthesis) can be skipped for them.
+//
+// Two tiers: an in-memory LRU of 'capacity' entries, and an optional persistent file. The file is an append-only log of
+// records (key length and value length as 32-bit little-endian integers, key, value); when the memory is opened it is
+// memory-mapped read-only (read into memory on Windows) and indexed, a truncated record at its end is cut off, and every
+// new translation is appended to it. A persistent hit is promoted into the LRU.
+class TranslationMemory final
+{
+public:
+    explicit TranslationMemory(size_t capacity, const std::string& persistentFileName = std::string())
+        : m_capacity(capacity), m_persistentFileName(persistentFileName)
+    {
+        if (!m_persistentFileName.empty())
+        {
+            MapPersistentFile();
+            auto validSize = IndexPersistentFile();
+            if (validSize < m_dataSize)
+            {
+                TruncatePersistentFile(validSize);
+            }
+            m_log.open(m_persistentFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+        }
+    }
+
+    ~TranslationMemory()
+    {
+#if !defined(_WIN32)
+        if (m_mapping != nullptr)
+        {
+            munmap(m_mapping, m_mappingSize);
+        }
+#endif
+    }
+
+    TranslationMemory(const TranslationMemory&) = delete;
+    TranslationMemory& operator=(const TranslationMemory&) = delete;
+
+    // Lowercases the text, collapses runs of whitespace into a single space and trims it, so that sentences that differ
+    // only in case or spacing share an entry.
+    static std::string Normalize(const std::string& text)
+    {
+        std::string normalized;
+        normalized.reserve(text.size());
+        bool space = false;
+        for (auto c : text)
+        {
+            if (isspace((unsigned char)c))
+            {
+                space = !normalized.empty();
+                continue;
+            }
+            if (space)
+            {
+                normalized.push_back(' ');
+                space = false;
+            }
+            normalized.push_back((char)tolower((unsigned char)c));
+        }
+        return normalized;
+    }
+
+    // Looks up the translation of 'sourceText'. Returns true and sets 'translation' on a hit.
+    bool Lookup(const std::string& sourceText, const std::string& sourceLanguage, const std::string& targetLanguage, std::string* translation)
+    {
+        auto key = MakeKey(sourceText, sourceLanguage, targetLanguage);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto entry = m_index.find(key);
+        if (entry != m_index.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, entry->second);
+            *translation = entry->second->second;
+            m_hits++;
+            return true;
+        }
+
+        auto persistent = m_persistentIndex.find(key);
+        if (persistent != m_persistentIndex.end())
+        {
+            translation->assign(persistent->second.first, persistent->second.second);
+            Insert(key, *translation);
+            m_hits++;
+            return true;
+        }
+
+        m_misses++;
+        return false;
+    }
+
+    // Stores the translation of 'sourceText', in memory and, if there is a persistent file, on disk.
+    void Store(const std::string& sourceText, const std::string& sourceLanguage, const std::string& targetLanguage, const std::string& translation)
+    {
+        auto key = MakeKey(sourceText, sourceLanguage, targetLanguage);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto entry = m_index.find(key);
+        if (entry != m_index.end())
+        {
+            if (entry->second->second == translation)
+            {
+                m_lru.splice(m_lru.begin(), m_lru, entry->second);
+                return;
+            }
+            m_lru.erase(entry->second);
+            m_index.erase(entry);
+        }
+        Insert(key, translation);
+
+        // The persistent tier still holds the previous translation, which must not come back once the new one is evicted
+        // from the LRU; the new one is found in the file when it is next opened.
+        m_persistentIndex.erase(key);
+
+        if (m_log.is_open())
+        {
+            char lengths[8];
+            WriteUInt32(lengths, (uint32_t)key.size());
+            WriteUInt32(lengths + 4, (uint32_t)translation.size());
+            m_log.write(lengths, sizeof(lengths));
+            m_log.write(key.data(), key.size());
+            m_log.write(translation.data(), translation.size());
+            m_log.flush();
+        }
+    }
+
+    uint64_t GetHits() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    uint64_t GetMisses() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+private:
+    static std::string MakeKey(const std::string& sourceText, const std::string& sourceLanguage, const std::string& targetLanguage)
+    {
+        // 0x1f (unit separator) does not occur in language tags or recognized text.
+        return sourceLanguage + '\x1f' + targetLanguage + '\x1f' + Normalize(sourceText);
+    }
+
+    static void WriteUInt32(char* data, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            data[i] = (char)(value >> (8 * i));
+        }
+    }
+
+    static uint32_t ReadUInt32(const char* data)
+    {
+        return (uint32_t)(uint8_t)data[0] | ((uint32_t)(uint8_t)data[1] << 8) | ((uint32_t)(uint8_t)data[2] << 16) | ((uint32_t)(uint8_t)data[3] << 24);
+    }
+
+    void Insert(const std::string& key, const std::string& translation)
+    {
+        m_lru.emplace_front(key, translation);
+        m_index[key] = m_lru.begin();
+        if (m_lru.size() > m_capacity)
+        {
+            m_index.erase(m_lru.back().first);
+            m_lru.pop_back();
+        }
+    }
+
+    void MapPersistentFile()
+    {
+#if defined(_WIN32)
+        std::ifstream file(m_persistentFileName, std::ios_base::binary);
+        m_fileContents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        m_data = m_fileContents.data();
+        m_dataSize = m_fileContents.size();
+#else
+        auto fd = open(m_persistentFileName.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0)
+        {
+            auto mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                m_mapping = mapping;
+                m_mappingSize = (size_t)status.st_size;
+                m_data = (const char*)mapping;
+                m_dataSize = m_mappingSize;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    // Indexes the records of the persistent file; a later record for the same key replaces an earlier one.
+    // Returns the size of the complete records, i.e. where a truncated record (from an interrupted write) starts.
+    size_t IndexPersistentFile()
+    {
+        size_t offset = 0;
+        while (m_dataSize - offset >= 8)
+        {
+            uint64_t keyLength = ReadUInt32(m_data + offset);
+            uint64_t valueLength = ReadUInt32(m_data + offset + 4);
+            auto keyOffset = offset + 8;
+            if (keyLength + valueLength > m_dataSize - keyOffset)
+            {
+                break;
+            }
+            auto valueOffset = keyOffset + (size_t)keyLength;
+            m_persistentIndex[std::string(m_data + keyOffset, (size_t)keyLength)] = std::make_pair(m_data + valueOffset, (size_t)valueLength);
+            offset = valueOffset + (size_t)valueLength;
+        }
+        return offset;
+    }
+
+    // Cuts a truncated record off the end of the file, so that appended records are not read as part of it.
+    void TruncatePersistentFile(size_t size)
+    {
+#if defined(_WIN32)
+        // The contents are held in memory, so the file can be rewritten from them.
+        std::ofstream(m_persistentFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc).write(m_data, (std::streamsize)size);
+#else
+        // The mapping stays valid for the records kept, which all lie before 'size'.
+        if (truncate(m_persistentFileName.c_str(), (off_t)size) != 0)
+        {
+            throw std::runtime_error("Failed to truncate the translation memory file.");
+        }
+#endif
+        m_dataSize = size;
+    }
+
+    size_t m_capacity;
+    std::string m_persistentFileName;
+
+    mutable std::mutex m_mutex;
+    std::list<std::pair<std::string, std::string>> m_lru;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> m_index;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+
+    // The persistent tier holds the file contents as of opening; records appended since are indexed when it is next opened.
+    const char* m_data = nullptr;
+    size_t m_dataSize = 0;
+#if defined(_WIN32)
+    std::vector<char> m_fileContents;
+#else
+    void* m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+#endif
+    std::unordered_map<std::string, std::pair<const char*, size_t>> m_persistentIndex;
+    std::ofstream m_log;
+};
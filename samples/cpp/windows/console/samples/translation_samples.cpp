@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <speechapi_cxx.h>
+#include "translation_memory.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -90,6 +91,11 @@ void TranslationContinuousRecognition()
     config->AddTargetLanguage("de");
     config->AddTargetLanguage("fr");
 
+    // Remembers the translations of recognized sentences (in memory, and across runs in translation_memory.bin), so that
+    // repeated sentences are answered from the translation memory and downstream processing can be skipped for them.
+    // Declared before the recognizer, so that it outlives the recognizer's event handlers.
+    TranslationMemory translationMemory(1000, "translation_memory.bin");
+
     // Creates a translation recognizer using microphone as audio input.
     auto recognizer = TranslationRecognizer::FromConfig(config);
 
@@ -103,7 +109,7 @@ void TranslationContinuousRecognition()
         }
     });
 
-    recognizer->Recognized.Connect([](const TranslationRecognitionEventArgs& e)
+    recognizer->Recognized.Connect([fromLanguage, &translationMemory](const TranslationRecognitionEventArgs& e)
     {
         if (e.Result->Reason == ResultReason::TranslatedSpeech)
         {
@@ -120,6 +126,15 @@ void TranslationContinuousRecognition()
 
         for (const auto& it : e.Result->Translations)
         {
+            // A repeated sentence: use the remembered translation; downstream processing of it can be skipped.
+            string remembered;
+            if (translationMemory.Lookup(e.Result->Text, fromLanguage, it.first, &remembered))
+            {
+                cout << "  Translated into '" << it.first.c_str() << "': " << remembered.c_str() << " (from translation memory)" << std::endl;
+                continue;
+            }
+
+            translationMemory.Store(e.Result->Text, fromLanguage, it.first, it.second);
             cout << "  Translated into '" << it.first.c_str() << "': " << it.second.c_str() << std::endl;
         }
     });
@@ -153,4 +168,6 @@ void TranslationContinuousRecognition()
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().get();
+
+    cout << "Translation memory: " << translationMemory.GetHits() << " hit(s), " << translationMemory.GetMisses() << " miss(es)" << std::endl;
 }
@@ -6,6 +6,9 @@
 
 #include <speechapi_cxx.h>
 #include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 // Helper functions
 class WavFileReader final
@@ -36,13 +39,44 @@ public:
         if (m_fs.eof())
             // returns 0 to indicate that the stream reaches end.
             return 0;
+        // Stops at the end of the data chunk, so chunks after it (e.g. LIST metadata) are not returned as audio.
+        if (m_dataSize != unknownDataSize && (uint64_t)size > m_dataSize - m_position)
+            size = (uint32_t)(m_dataSize - m_position);
+        if (size == 0)
+            return 0;
         m_fs.read((char*)dataBuffer, size);
         if (!m_fs.eof() && !m_fs.good())
             // returns 0 to close the stream on read error.
             return 0;
-        else
-            // returns the number of bytes that have been read.
-            return (int)m_fs.gcount();
+        m_position += (uint64_t)m_fs.gcount();
+        // returns the number of bytes that have been read.
+        return (int)m_fs.gcount();
+    }
+
+    // Moves the read position to the frame (sample of every channel) 'frameIndex' of the audio data.
+    void Seek(uint64_t frameIndex)
+    {
+        SeekToOffset(frameIndex * m_formatHeader.BlockAlign);
+    }
+
+    // Reads from the byte 'offset' of the audio data, like a Seek() followed by Read(). The offset should be a multiple
+    // of GetFormat().BlockAlign. To process parts of a file in parallel, use one reader per thread.
+    int ReadAt(uint64_t offset, uint8_t* dataBuffer, uint32_t size)
+    {
+        SeekToOffset(offset);
+        return Read(dataBuffer, size);
+    }
+
+    // Number of frames in the audio data, or 0 if the header does not say (e.g. a file written while streaming).
+    uint64_t GetFrameCount() const
+    {
+        return m_dataSize == unknownDataSize || m_formatHeader.BlockAlign == 0 ? 0 : m_dataSize / m_formatHeader.BlockAlign;
+    }
+
+    // Current read position in the audio data, in bytes.
+    uint64_t GetPosition() const
+    {
+        return m_position;
     }
 
     void Close()
@@ -50,30 +84,61 @@ public:
         m_fs.close();
     }
 
+    // The format structure expected in wav files.
+    struct WAVEFORMAT
+    {
+        uint16_t FormatTag;        // format type.
+        uint16_t Channels;         // number of channels (i.e. mono, stereo...).
+        uint32_t SamplesPerSec;    // sample rate.
+        uint32_t AvgBytesPerSec;   // for buffer estimation.
+        uint16_t BlockAlign;       // block size of data.
+        uint16_t BitsPerSample;    // Number of bits per sample of mono data.
+    };
+    static_assert(sizeof(WAVEFORMAT) == 16, "unexpected size of WAVEFORMAT");
+
+    // Gets the format read from the file header.
+    const WAVEFORMAT& GetFormat() const
+    {
+        return m_formatHeader;
+    }
+
+    // Gets the sample encoding (e.g. 1 for integer PCM, 3 for IEEE float); for WAVE_FORMAT_EXTENSIBLE files this is
+    // taken from the sub-format instead of FormatTag.
+    uint16_t GetSampleFormatTag() const
+    {
+        return m_sampleFormatTag;
+    }
+
 private:
     // Defines common constants for WAV format.
     static constexpr uint16_t tagBufferSize = 4;
     static constexpr uint16_t chunkTypeBufferSize = 4;
     static constexpr uint16_t chunkSizeBufferSize = 4;
 
+    // RF64/BW64 files put 0xFFFFFFFF in 32-bit size fields that do not fit, and give the real size in the 'ds64' chunk.
+    static constexpr uint32_t sizeInDs64 = 0xFFFFFFFF;
+    static constexpr uint64_t unknownDataSize = UINT64_MAX;
+    static constexpr uint16_t formatExtensible = 0xFFFE;
+
     // Get format data from a wav file.
     void GetFormatFromWavFile()
     {
         char tag[tagBufferSize];
         char chunkType[chunkTypeBufferSize];
         char chunkSizeBuffer[chunkSizeBufferSize];
-        uint32_t chunkSize = 0;
+        uint64_t chunkSize = 0;
 
         // Set to throw exceptions when reading file header.
         m_fs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
         try
         {
-            // Checks the RIFF tag
+            // Checks the RIFF tag; RF64 (EBU Tech 3306) and BW64 (ITU-R BS.2088) are its 64-bit variants.
             m_fs.read(tag, tagBufferSize);
-            if (memcmp(tag, "RIFF", tagBufferSize) != 0)
+            bool is64Bit = memcmp(tag, "RF64", tagBufferSize) == 0 || memcmp(tag, "BW64", tagBufferSize) == 0;
+            if (memcmp(tag, "RIFF", tagBufferSize) != 0 && !is64Bit)
             {
-                throw std::runtime_error("Invalid file header, tag 'RIFF' is expected.");
+                throw std::runtime_error("Invalid file header, tag 'RIFF', 'RF64' or 'BW64' is expected.");
             }
 
             // The next is the RIFF chunk size, ignore now.
@@ -86,29 +151,82 @@ private:
                 throw std::runtime_error("Invalid file header, tag 'WAVE' is expected.");
             }
 
+            // 64-bit sizes of the data chunk and of other large chunks, from the 'ds64' chunk.
+            uint64_t ds64DataSize = unknownDataSize;
+            std::vector<std::pair<std::string, uint64_t>> ds64ChunkSizes;
+
             bool foundDataChunk = false;
             while (!foundDataChunk && m_fs.good() && !m_fs.eof())
             {
                 ReadChunkTypeAndSize(chunkType, &chunkSize);
-                if (memcmp(chunkType, "fmt ", chunkTypeBufferSize) == 0)
+                if (chunkSize == sizeInDs64 && is64Bit)
+                {
+                    for (const auto& ds64ChunkSize : ds64ChunkSizes)
+                    {
+                        if (memcmp(chunkType, ds64ChunkSize.first.data(), chunkTypeBufferSize) == 0)
+                        {
+                            chunkSize = ds64ChunkSize.second;
+                        }
+                    }
+                }
+
+                if (memcmp(chunkType, "ds64", chunkTypeBufferSize) == 0)
+                {
+                    // RIFF size, data size and sample count (64 bits each), then a table of other chunk sizes.
+                    ReadUInt64();
+                    ds64DataSize = ReadUInt64();
+                    ReadUInt64();
+                    auto tableLength = ReadUInt32();
+                    for (uint32_t i = 0; i < tableLength; i++)
+                    {
+                        char tableChunkType[chunkTypeBufferSize];
+                        m_fs.read(tableChunkType, chunkTypeBufferSize);
+                        ds64ChunkSizes.emplace_back(std::string(tableChunkType, chunkTypeBufferSize), ReadUInt64());
+                    }
+                    auto read = 28 + (uint64_t)tableLength * 12;
+                    if (chunkSize > read)
+                    {
+                        SkipChunkData(chunkSize - read);
+                    }
+                }
+                else if (memcmp(chunkType, "fmt ", chunkTypeBufferSize) == 0)
                 {
                     // Reads format data.
                     m_fs.read((char *)&m_formatHeader, sizeof(m_formatHeader));
+                    m_sampleFormatTag = m_formatHeader.FormatTag;
+                    auto read = (uint64_t)sizeof(m_formatHeader);
+
+                    // WAVE_FORMAT_EXTENSIBLE: extension size, valid bits, channel mask, then the sub-format GUID,
+                    // which starts with the format tag.
+                    if (m_formatHeader.FormatTag == formatExtensible && chunkSize >= sizeof(m_formatHeader) + 10)
+                    {
+                        uint8_t extension[10];
+                        m_fs.read((char*)extension, sizeof(extension));
+                        m_sampleFormatTag = (uint16_t)(extension[8] | (extension[9] << 8));
+                        read += sizeof(extension);
+                    }
 
                     // Skips the rest of format data.
-                    if (chunkSize > sizeof(m_formatHeader))
+                    if (chunkSize > read)
                     {
-                        m_fs.seekg(chunkSize - sizeof(m_formatHeader), std::ios_base::cur);
+                        SkipChunkData(chunkSize - read);
                     }
                 }
                 else if (memcmp(chunkType, "data", chunkTypeBufferSize) == 0)
                 {
                     foundDataChunk = true;
+                    if (chunkSize == sizeInDs64 && is64Bit)
+                    {
+                        chunkSize = ds64DataSize;
+                    }
+                    // Streaming writers may leave the size at 0 (or 0xFFFFFFFF) until they finish; then the data
+                    // runs to the end of the file.
+                    m_dataSize = chunkSize == 0 || chunkSize == sizeInDs64 ? unknownDataSize : chunkSize;
                     break;
                 }
                 else
                 {
-                    m_fs.seekg(chunkSize, std::ios_base::cur);
+                    SkipChunkData(chunkSize);
                 }
             }
 
@@ -120,8 +238,9 @@ private:
             {
                 throw std::runtime_error("Unexpected end of file, before any audio data can be read.");
             }
+            m_dataOffset = (uint64_t)m_fs.tellg();
         }
-        catch (std::ifstream::failure e)
+        catch (const std::ifstream::failure&)
         {
             throw std::runtime_error("Unexpected end of file or error when reading audio file.");
         }
@@ -129,33 +248,54 @@ private:
         m_fs.exceptions(std::ifstream::goodbit);
     }
 
-    void ReadChunkTypeAndSize(char* chunkType, uint32_t* chunkSize)
+    void ReadChunkTypeAndSize(char* chunkType, uint64_t* chunkSize)
     {
         // Read the chunk type
         m_fs.read(chunkType, chunkTypeBufferSize);
 
         // Read the chunk size
-        uint8_t chunkSizeBuffer[chunkSizeBufferSize];
-        m_fs.read((char*)chunkSizeBuffer, chunkSizeBufferSize);
-
-        // chunk size is little endian
-        *chunkSize = ((uint32_t)chunkSizeBuffer[3] << 24) |
-            ((uint32_t)chunkSizeBuffer[2] << 16) |
-            ((uint32_t)chunkSizeBuffer[1] << 8) |
-            (uint32_t)chunkSizeBuffer[0];
+        *chunkSize = ReadUInt32();
     }
 
-    // The format structure expected in wav files.
-    struct WAVEFORMAT
+    // Skips the data of a chunk, including the pad byte that follows chunks of odd size.
+    void SkipChunkData(uint64_t size)
     {
-        uint16_t FormatTag;        // format type.
-        uint16_t Channels;         // number of channels (i.e. mono, stereo...).
-        uint32_t SamplesPerSec;    // sample rate.
-        uint32_t AvgBytesPerSec;   // for buffer estimation.
-        uint16_t BlockAlign;       // block size of data.
-        uint16_t BitsPerSample;    // Number of bits per sample of mono data.
-    } m_formatHeader;
-    static_assert(sizeof(m_formatHeader) == 16, "unexpected size of m_formatHeader");
+        m_fs.seekg((std::streamoff)(size + (size & 1)), std::ios_base::cur);
+    }
+
+    // Reads a little endian integer.
+    uint32_t ReadUInt32()
+    {
+        uint8_t buffer[4];
+        m_fs.read((char*)buffer, sizeof(buffer));
+        return ((uint32_t)buffer[3] << 24) |
+            ((uint32_t)buffer[2] << 16) |
+            ((uint32_t)buffer[1] << 8) |
+            (uint32_t)buffer[0];
+    }
+
+    uint64_t ReadUInt64()
+    {
+        auto low = ReadUInt32();
+        return ((uint64_t)ReadUInt32() << 32) | low;
+    }
+
+    void SeekToOffset(uint64_t offset)
+    {
+        if (m_dataSize != unknownDataSize && offset > m_dataSize)
+        {
+            throw std::out_of_range("Seek beyond the end of the audio data.");
+        }
+        m_fs.clear();
+        m_fs.seekg((std::streamoff)(m_dataOffset + offset), std::ios_base::beg);
+        m_position = offset;
+    }
+
+    WAVEFORMAT m_formatHeader;
+    uint16_t m_sampleFormatTag = 0;
+    uint64_t m_dataOffset = 0;
+    uint64_t m_dataSize = unknownDataSize;
+    uint64_t m_position = 0;
 
 private:
     std::fstream m_fs;
@@ -0,0 +1,230 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pcm_format.h"
+
+// Helpers to recognize one long file as several overlapping windows in parallel, and to merge the transcripts.
+//
+// Every window is recognized by its own recognizer from its own reader, so the windows proceed concurrently instead of
+// one session working through the whole file. Adjacent windows share an overlap; words in it are recognized twice, and
+// the merge keeps each of them once.
+
+// A part of the file, in frames.
+struct RecognitionWindow
+{
+    uint64_t StartFrame;
+    uint64_t EndFrame;
+};
+
+// A recognized word with its offset from the start of the file, in ticks of 100 ns.
+struct TimedWord
+{
+    std::string Text;   // As recognized, e.g. "Weather,".
+    std::string Key;    // Lowercase letters and digits, for comparison, e.g. "weather".
+    uint64_t Offset;
+};
+
+// Splits 'frameCount' frames into 'count' windows of equal length, each overlapping the next by 'overlapFrames'.
+inline std::vector<RecognitionWindow> SplitIntoWindows(uint64_t frameCount, size_t count, uint64_t overlapFrames)
+{
+    std::vector<RecognitionWindow> windows;
+    count = std::max<size_t>(1, count);
+    auto step = frameCount / count;
+    for (size_t i = 0; i < count; i++)
+    {
+        auto start = i * step;
+        auto end = i + 1 == count ? frameCount : std::min(frameCount, (i + 1) * step + overlapFrames);
+        windows.push_back(RecognitionWindow{ start, end });
+    }
+    return windows;
+}
+
+// Reads the audio of one window of a wav file as 16-bit PCM, starting with a seek instead of reading from the start.
+class WindowWavFileReader final
+{
+public:
+    WindowWavFileReader(const std::string& audioFileName, const RecognitionWindow& window)
+        : m_reader(audioFileName)
+    {
+        m_remainingBytes = (window.EndFrame - window.StartFrame) * m_reader.GetFormat().BlockAlign;
+        m_reader.Seek(window.StartFrame);
+    }
+
+    // Same as WavFileReader::Read(); returns 0 only at the end of the window. A request that ends within a frame gets
+    // the start of it (Int16WavFileReader keeps the rest for the next read).
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        auto read = m_reader.Read(dataBuffer, (uint32_t)std::min<uint64_t>(size, m_remainingBytes));
+        m_remainingBytes -= (uint64_t)read;
+        return read;
+    }
+
+    void Close()
+    {
+        m_reader.Close();
+    }
+
+    const WavFileReader::WAVEFORMAT& GetFormat() const
+    {
+        return m_reader.GetFormat();
+    }
+
+private:
+    Int16WavFileReader m_reader;
+    uint64_t m_remainingBytes;
+};
+
+// Splits a recognized phrase into words. Phrase results carry no word timing, so word offsets are interpolated over
+// the phrase duration by character position; the merge tolerates the resulting error.
+inline void AppendPhraseWords(std::vector<TimedWord>& words, const std::string& text, uint64_t offset, uint64_t duration)
+{
+    size_t position = 0;
+    while (position < text.size())
+    {
+        auto start = text.find_first_not_of(' ', position);
+        if (start == std::string::npos)
+        {
+            break;
+        }
+        auto end = std::min(text.find(' ', start), text.size());
+
+        TimedWord word{ text.substr(start, end - start), std::string(), offset + duration * start / text.size() };
+        for (auto c : word.Text)
+        {
+            if (isalnum((unsigned char)c) || (unsigned char)c >= 0x80)
+            {
+                word.Key.push_back((char)tolower((unsigned char)c));
+            }
+        }
+        words.push_back(word);
+        position = end;
+    }
+}
+
+// Merges the transcripts of consecutive overlapping windows (words with file offsets, in order) into one.
+//
+// The words of two adjacent windows in their overlap are aligned by edit distance, with words matching if they
+// compare equal and are close in time. The transcripts are joined at the matched word nearest the middle of the
+// overlap: words near the edge of a window were recognized with little context on one side and are the less reliable
+// hypothesis, so each side contributes the part of the overlap farther from its edge. Without any match, the join is
+// at the middle of the overlap by time.
+inline std::vector<TimedWord> MergeWindowTranscripts(const std::vector<std::vector<TimedWord>>& transcripts,
+    const std::vector<RecognitionWindow>& windows, uint32_t sampleRate, uint64_t toleranceTicks = 10000000)
+{
+    auto ticks = [sampleRate](uint64_t frame) { return frame * 10000000 / sampleRate; };
+
+    std::vector<TimedWord> merged;
+    size_t firstOfNext = 0; // Words of the current window before this index were already covered by the previous one.
+    for (size_t w = 0; w < transcripts.size(); w++)
+    {
+        const auto& current = transcripts[w];
+        if (w + 1 == transcripts.size())
+        {
+            merged.insert(merged.end(), current.begin() + std::min(firstOfNext, current.size()), current.end());
+            break;
+        }
+
+        const auto& next = transcripts[w + 1];
+        auto overlapStart = ticks(windows[w + 1].StartFrame);
+        auto overlapEnd = ticks(windows[w].EndFrame);
+        auto middle = overlapStart + (overlapEnd - overlapStart) / 2;
+
+        // The words of each side that fall in the overlap (with tolerance for interpolated offsets).
+        size_t a = std::min(firstOfNext, current.size());
+        while (a < current.size() && current[a].Offset + toleranceTicks < overlapStart)
+        {
+            a++;
+        }
+        size_t bEnd = 0;
+        while (bEnd < next.size() && next[bEnd].Offset < overlapEnd + toleranceTicks)
+        {
+            bEnd++;
+        }
+        auto aCount = current.size() - a;
+
+        // Edit distance between current[a...] and next[0, bEnd), then the matched pairs along the best path.
+        auto matches = [&](size_t i, size_t j)
+        {
+            const auto& x = current[a + i];
+            const auto& y = next[j];
+            auto distance = x.Offset > y.Offset ? x.Offset - y.Offset : y.Offset - x.Offset;
+            return x.Key == y.Key && distance <= toleranceTicks;
+        };
+        std::vector<std::vector<uint32_t>> cost(aCount + 1, std::vector<uint32_t>(bEnd + 1));
+        for (size_t i = 0; i <= aCount; i++)
+        {
+            for (size_t j = 0; j <= bEnd; j++)
+            {
+                if (i == 0 || j == 0)
+                {
+                    cost[i][j] = (uint32_t)(i + j);
+                }
+                else
+                {
+                    cost[i][j] = std::min(std::min(cost[i - 1][j], cost[i][j - 1]) + 1, cost[i - 1][j - 1] + (matches(i - 1, j - 1) ? 0 : 1));
+                }
+            }
+        }
+
+        // Follows the path back, remembering the matched pair nearest to the middle of the overlap.
+        size_t cutA = aCount, cutB = bEnd;
+        bool found = false;
+        uint64_t bestDistance = UINT64_MAX;
+        for (size_t i = aCount, j = bEnd; i > 0 && j > 0;)
+        {
+            if (matches(i - 1, j - 1) && cost[i][j] == cost[i - 1][j - 1])
+            {
+                auto offset = next[j - 1].Offset;
+                auto distance = offset > middle ? offset - middle : middle - offset;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    cutA = i - 1;
+                    cutB = j - 1;
+                    found = true;
+                }
+                i--, j--;
+            }
+            else if (cost[i][j] == cost[i - 1][j] + 1)
+            {
+                i--;
+            }
+            else if (cost[i][j] == cost[i][j - 1] + 1)
+            {
+                j--;
+            }
+            else
+            {
+                i--, j--;
+            }
+        }
+
+        if (!found)
+        {
+            cutA = 0;
+            while (cutA < aCount && current[a + cutA].Offset < middle)
+            {
+                cutA++;
+            }
+            cutB = 0;
+            while (cutB < next.size() && next[cutB].Offset < middle)
+            {
+                cutB++;
+            }
+        }
+
+        // The current window up to the join; the next one continues with its matching word.
+        merged.insert(merged.end(), current.begin() + std::min(firstOfNext, current.size()), current.begin() + a + cutA);
+        firstOfNext = cutB;
+    }
+    return merged;
+}